@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+// Running heap totals kept by the replacement global operator new in
+// allocstats.cpp. They cover every thread and only ever grow, so callers
+// measure a span of work by subtracting two snapshots.
+struct AllocStats {
+    uint64_t count;
+    uint64_t bytes;
+};
+
+AllocStats allocStats();
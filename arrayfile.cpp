@@ -0,0 +1,141 @@
+#include "arrayfile.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char magic[8] = {'S', 'I', 'C', 'A', 'R', 'R', 'A', 'Y'};
+constexpr uint32_t float64Type = 1;
+
+// Validates the header at the start of a file of `fileSize` bytes, filling
+// `shape` and the offset of the first element
+bool parseHeader(const unsigned char* bytes, size_t fileSize, std::vector<size_t>& shape, size_t& dataOffset) {
+    if (fileSize < 16 || std::memcmp(bytes, magic, sizeof magic) != 0) return false;
+    uint32_t type, rank;
+    std::memcpy(&type, bytes + 8, 4);
+    std::memcpy(&rank, bytes + 12, 4);
+    if (type != float64Type || rank == 0 || fileSize < 16 + size_t(rank) * 8) return false;
+
+    dataOffset = 16 + size_t(rank) * 8;
+    size_t count = 1;
+    shape.resize(rank);
+    for (uint32_t i = 0; i < rank; ++i) {
+        uint64_t dim;
+        std::memcpy(&dim, bytes + 16 + i * 8, 8);
+        if (dim != 0 && count > (fileSize / 8) / dim) return false;
+        shape[i] = static_cast<size_t>(dim);
+        count *= shape[i];
+    }
+    return fileSize - dataOffset == count * 8;
+}
+
+}  // namespace
+
+bool saveArray(const std::filesystem::path& path, const NDArray& arr, String& error) {
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+    bool written;
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            error = L"Cannot write " + path.wstring();
+            return false;
+        }
+        uint32_t type = float64Type, rank = static_cast<uint32_t>(arr.rank());
+        file.write(magic, sizeof magic);
+        file.write(reinterpret_cast<const char*>(&type), 4);
+        file.write(reinterpret_cast<const char*>(&rank), 4);
+        for (size_t dim : arr.shape) {
+            uint64_t d = dim;
+            file.write(reinterpret_cast<const char*>(&d), 8);
+        }
+        file.write(reinterpret_cast<const char*>(arr.data.data()), static_cast<std::streamsize>(arr.size() * 8));
+        file.close();
+        written = !file.fail();
+    }
+    // A partial temp file is removed whether writing or renaming failed
+    std::error_code ec;
+    if (written) std::filesystem::rename(temp, path, ec);
+    if (!written || ec) {
+        std::filesystem::remove(temp, ec);
+        error = L"Cannot write " + path.wstring();
+        return false;
+    }
+    return true;
+}
+
+#if !defined(_WIN32)
+
+bool mapFile(const std::filesystem::path& path, MappedFile& out, String& error) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = L"Cannot open " + path.wstring();
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        error = L"Cannot open " + path.wstring();
+        return false;
+    }
+    out = MappedFile();
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+    // Private and writable: stores go to copy-on-write pages, never the file
+    void* region = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (region == MAP_FAILED) {
+        error = L"Cannot open " + path.wstring();
+        return false;
+    }
+    out.keepAlive = std::shared_ptr<void>(region, [size](void* p) { ::munmap(p, size); });
+    out.bytes = static_cast<unsigned char*>(region);
+    out.size = size;
+    return true;
+}
+
+#else
+
+bool mapFile(const std::filesystem::path& path, MappedFile& out, String& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = L"Cannot open " + path.wstring();
+        return false;
+    }
+    auto bytes = std::make_shared<std::vector<unsigned char>>(
+        std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    out.bytes = bytes->data();
+    out.size = bytes->size();
+    out.keepAlive = std::move(bytes);
+    return true;
+}
+
+#endif
+
+bool loadArray(const std::filesystem::path& path, NDArray& out, String& error) {
+    MappedFile file;
+    if (!mapFile(path, file, error)) return false;
+
+    std::vector<size_t> shape;
+    size_t offset;
+    if (!parseHeader(file.bytes, file.size, shape, offset)) {
+        error = path.wstring() + L" is not an array file";
+        return false;
+    }
+    size_t count = (file.size - offset) / 8;
+    double* first = reinterpret_cast<double*>(file.bytes + offset);
+    out.reshape(shape);
+    out.data = Buffer(std::move(file.keepAlive), first, count);
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "types.hpp"
+#include <filesystem>
+
+// Binary array files, as written by `save` and read by `load`:
+//
+//   offset 0   8 bytes    magic "SICARRAY"
+//   offset 8   uint32     element type; 1 = float64
+//   offset 12  uint32     rank
+//   offset 16  uint64     shape, one per axis
+//   then                  the elements as raw row-major doubles
+//
+// All fields use the host's byte order, and the header size is a multiple
+// of 8, so the elements are aligned.
+
+// Writes `arr` to `path` through a temporary file that replaces `path` once
+// complete, so mappings of the old file stay intact. On failure returns false
+// and sets `error`.
+bool saveArray(const std::filesystem::path& path, const NDArray& arr, String& error);
+
+// Maps the file privately and wraps the elements without copying: pages are
+// read on demand, and a write only copies the page it touches, never changing
+// the file. Platforms without mmap read the file instead.
+bool loadArray(const std::filesystem::path& path, NDArray& out, String& error);
+
+// A whole file in memory, valid while keepAlive is held
+struct MappedFile {
+    std::shared_ptr<void> keepAlive;
+    unsigned char* bytes = nullptr;
+    size_t size = 0;
+};
+
+// Maps `path` the way loadArray does, so Buffers may borrow from the bytes
+bool mapFile(const std::filesystem::path& path, MappedFile& out, String& error);
@@ -0,0 +1,84 @@
+#include "batch.hpp"
+#include "interpreter.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+struct Result {
+    bool done = false;
+    String out;
+    String errors;
+};
+
+// One worker's interpreter and the buffers it prints into
+struct Worker {
+    std::wostringstream out;
+    std::wostringstream errors;
+    Interpreter interp{out, errors, 1};
+};
+
+}  // namespace
+
+bool runBatch(const std::filesystem::path& dir, size_t jobs, Interpreter& prelude) {
+    std::error_code ec;
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.is_regular_file()) files.push_back(entry.path());
+    }
+    if (ec) {
+        std::wcerr << L"Error: Cannot read directory " << dir.wstring() << std::endl;
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+
+    jobs = std::max<size_t>(1, std::min(jobs, files.size()));
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < jobs; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+
+    prelude.freeze();
+    std::vector<Result> results(files.size());
+    std::atomic<size_t> next{0};
+    std::atomic<bool> ok{true};
+    std::mutex printing;
+    size_t printed = 0;
+
+    // Workers claim scripts from a shared counter, so a slow script holds up
+    // only its own worker
+    ThreadPool pool(jobs);
+    pool.parallelFor(jobs, [&](size_t w) {
+        Worker& worker = *workers[w];
+        for (size_t i; (i = next.fetch_add(1)) < files.size();) {
+            std::wifstream script(files[i]);
+            if (script) {
+                script.imbue(std::locale());
+                worker.interp.reset(prelude);
+                worker.interp.processStream(script);
+            }
+            else {
+                worker.errors << L"Error: Cannot open " << files[i].wstring() << std::endl;
+                ok = false;
+            }
+
+            std::lock_guard<std::mutex> lock(printing);
+            results[i] = {true, worker.out.str(), worker.errors.str()};
+            worker.out.str(L"");
+            worker.errors.str(L"");
+            for (; printed < results.size() && results[printed].done; ++printed) {
+                std::wcout << results[printed].out << std::flush;
+                std::wcerr << results[printed].errors << std::flush;
+                results[printed].out = String();
+                results[printed].errors = String();
+            }
+        }
+    });
+    return ok;
+}
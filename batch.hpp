@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+class Interpreter;
+
+// Runs every regular file in `dir` as an independent script, `jobs` at a time.
+// Each worker has its own Interpreter, reset to `prelude`'s words before
+// every script, so scripts share those definitions but nothing else;
+// `prelude` is frozen first so that a reset does not copy them. The
+// output and errors of each script are printed whole, in file name order, as
+// soon as it and every script before it have finished. Returns false if any
+// file could not be read.
+bool runBatch(const std::filesystem::path& dir, size_t jobs, Interpreter& prelude);
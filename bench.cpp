@@ -0,0 +1,182 @@
+// Benchmark driver built by `make bench`. Runs a fixed suite against the
+// interpreter and prints the results as JSON on stdout:
+//
+//   siclang-bench [--min-time SECONDS] [FILTER]
+//
+// Only cases whose name contains FILTER run. Each case repeats until it has
+// run for at least --min-time seconds (default 0.5), and reports the time,
+// heap allocations and bytes allocated per operation (see allocstats.hpp).
+
+#include "interpreter.hpp"
+#include "allocstats.hpp"
+#include "simd.hpp"
+#include "tokenizer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Swallows whatever the interpreter prints
+struct NullBuffer : std::wstreambuf {
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const wchar_t*, std::streamsize n) override { return n; }
+};
+
+struct Result {
+    std::string name;
+    size_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+};
+
+double minTime = 0.5;
+
+// Calls op() often enough to fill minTime, growing the count the way Go's
+// testing.B does; `perOp` splits each call into that many operations
+Result measure(const std::string& name, size_t perOp, const std::function<void()>& op) {
+    using Clock = std::chrono::steady_clock;
+    op();  // warm-up
+
+    size_t iterations = 1;
+    while (true) {
+        AllocStats before = allocStats();
+        auto start = Clock::now();
+        for (size_t i = 0; i < iterations; ++i) op();
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (elapsed >= minTime || iterations >= (size_t(1) << 30)) {
+            AllocStats after = allocStats();
+            double ops = static_cast<double>(iterations * perOp);
+            return {name, iterations * perOp, elapsed * 1e9 / ops,
+                (after.count - before.count) / ops, (after.bytes - before.bytes) / ops};
+        }
+        double scale = elapsed > 0 ? minTime / elapsed * 1.2 : 100;
+        iterations = static_cast<size_t>(iterations * std::min(100.0, std::max(2.0, scale)));
+    }
+}
+
+// Literal text for an array of the given shape holding 1, 2, ... 9, 1, 2, ...
+String literal(const std::vector<size_t>& shape, size_t axis = 0) {
+    if (axis == shape.size()) return L"";
+    String text = L"[";
+    for (size_t i = 0; i < shape[axis]; ++i) {
+        if (i > 0) text += L", ";
+        text += axis + 1 < shape.size() ? literal(shape, axis + 1) : std::to_wstring(i % 9 + 1);
+    }
+    return text + L"]";
+}
+
+// Interpreter with the words a case needs; the timed operation runs `line`.
+// Cases push their operands in `line` and let op consume them: word bodies
+// that named the operands themselves would be folded to constants when op is
+// defined, leaving nothing to measure.
+struct Fixture {
+    Interpreter interp;
+    String line;
+
+    Fixture(const String& setup, const String& line) : line(line) { interp.process(setup); }
+    void run() { interp.process(line); }
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            minTime = std::atof(argv[++i]);
+        }
+        else {
+            filter = argv[i];
+        }
+    }
+
+    NullBuffer null;
+    std::wcout.rdbuf(&null);
+
+    std::vector<Result> results;
+    auto wanted = [&](const std::string& name) { return name.find(filter) != std::string::npos; };
+    auto bench = [&](const std::string& name, const String& setup, const String& line, size_t perOp = 1) {
+        if (!wanted(name)) return;
+        Fixture fixture(setup, line);
+        results.push_back(measure(name, perOp, [&] { fixture.run(); }));
+    };
+
+    if (wanted("tokenize/64KiB")) {
+        String script;
+        while (script.size() < 65536) {
+            script += L"[1, 2, 3] dup + :sq dup * :end 3 sq . \"text\" 'c' 2.5e3 matmul\n";
+        }
+        results.push_back(measure("tokenize/64KiB", 1, [&] {
+            TokenList tokens;
+            StreamTokenizer tokenizer;
+            tokenizer.feed(script, true, tokens);
+        }));
+    }
+
+    if (wanted("parse/1000")) {
+        Interpreter interp;
+        String line = literal({1000}) + L" clear";
+        results.push_back(measure("parse/1000", 1, [&] { interp.process(line); }));
+    }
+
+    for (size_t n : {100, 10000, 1000000}) {
+        String operands = L":a " + literal({n}) + L" :end :b " + literal({n}) + L" :end ";
+        bench("add/" + std::to_string(n), operands + L":op + clear :end", L"a b op");
+        bench("sqrt/" + std::to_string(n), operands + L":op sqrt clear :end", L"a op");
+        bench("fma/" + std::to_string(n), operands + L":op fma clear :end", L"a b a op");
+        bench("dot/" + std::to_string(n), operands + L":op dot clear :end", L"a b op");
+    }
+
+    for (size_t n : {16, 64, 256}) {
+        String operand = literal({n, n});
+        bench("matmul/" + std::to_string(n),
+            L":a " + operand + L" :end :b " + operand + L" :end :op matmul clear :end", L"a b op");
+    }
+
+    bench("outer/1000", L":a " + literal({1000}) + L" :end :op outer clear :end", L"a a op");
+
+    // A column of a 1000 x 1000 matrix, and a product with a transposed operand
+    bench("column/1000", L":a " + literal({1000, 1000}) + L" :end :op transpose 3 at clear :end", L"a op");
+    bench("matmul/transposed256",
+        L":a " + literal({256, 256}) + L" :end :op dup transpose matmul clear :end", L"a op");
+
+    bench("reshape/1000000", L":a " + literal({1000000}) + L" :end :op [1000, 1000] reshape clear :end", L"a op");
+
+    // Strings: two short literals, and two arrays of 10000 words
+    bench("cat/text", L":op cat clear :end", L"\"hello\" \"world\" op");
+    String words = L"[";
+    for (size_t i = 0; i < 10000; ++i) words += (i ? L", \"w" : L"\"w") + std::to_wstring(i) + L"\"";
+    bench("cat/text10000", L":a " + words + L"] :end :op cat clear :end", L"a a op");
+
+    // Eight builtins on single numbers per operation. The operand is left on
+    // the stack by the setup, so linking cannot fold the arithmetic away, and
+    // `0 * +` puts it back unchanged for the next run.
+    bench("scalar", L"1 :op dup 2 + 3 * 4 - 2 / sqrt 0 * + :end", L"op", 8);
+
+    // Ten calls of an empty word per operation
+    bench("call", L":f :end :op f f f f f f f f f f :end", L"op", 10);
+
+    for (size_t n : {1000, 100000}) {
+        bench("print/" + std::to_string(n), L":a " + literal({n}) + L" :end :op a . :end", L"op");
+    }
+
+    std::printf("{\n  \"simd\": \"%s\",\n  \"threads\": %zu,\n  \"results\": [", simdKernels().name,
+        ThreadPool::defaultThreadCount());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        std::printf("%s\n    {\"name\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.1f, "
+            "\"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}",
+            i ? "," : "", r.name.c_str(), r.iterations, r.nsPerOp, r.allocsPerOp, r.bytesPerOp);
+    }
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "broadcast.hpp"
+#include <algorithm>
+
+bool broadcastShape(const std::vector<size_t>& a, const std::vector<size_t>& b, std::vector<size_t>& out) {
+    size_t rank = std::max(a.size(), b.size());
+    std::vector<size_t> shape(rank);
+    for (size_t i = 0; i < rank; ++i) {
+        size_t x = i < a.size() ? a[a.size() - 1 - i] : 1;
+        size_t y = i < b.size() ? b[b.size() - 1 - i] : 1;
+        if (x != y && x != 1 && y != 1) return false;
+        shape[rank - 1 - i] = x == 1 ? y : x;
+    }
+    out = std::move(shape);
+    return true;
+}
+
+namespace {
+
+// One loop of the iteration: its length and the step taken in each buffer
+struct Axis {
+    size_t size;
+    size_t a;
+    size_t b;
+    size_t out;
+};
+
+// Stride of `arr` along output axis `axis` of a rank-`rank` result: 0 where
+// the array is broadcast, either because it lacks the axis or has size 1 there
+size_t broadcastStride(const NDArray& arr, size_t rank, size_t axis) {
+    size_t missing = rank - arr.rank();
+    if (axis < missing || arr.shape[axis - missing] == 1) return 0;
+    return arr.strides[axis - missing];
+}
+
+}  // namespace
+
+void broadcastApply(BinaryKernelFn kernel, const NDArray& a, const NDArray& b, NDArray& out) {
+    // Build the loop nest innermost first, folding each axis into the one
+    // inside it whenever all three buffers step through both as one run
+    std::vector<Axis> axes;
+    size_t rank = out.rank();
+    for (size_t i = rank; i-- > 0;) {
+        if (out.shape[i] == 1) continue;
+        Axis axis{out.shape[i], broadcastStride(a, rank, i), broadcastStride(b, rank, i), out.strides[i]};
+        if (!axes.empty()) {
+            Axis& inner = axes.back();
+            if (axis.a == inner.a * inner.size && axis.b == inner.b * inner.size
+                && axis.out == inner.out * inner.size) {
+                inner.size *= axis.size;
+                continue;
+            }
+        }
+        axes.push_back(axis);
+    }
+    if (axes.empty()) axes.push_back({1, 0, 0, 1});
+
+    // The kernel wants contiguous or stride-0 rows; anything else goes one
+    // element at a time
+    Axis inner = axes.front();
+    bool rowKernel = inner.a <= 1 && inner.b <= 1 && inner.out == 1;
+    size_t outer = 1;
+    for (size_t i = 1; i < axes.size(); ++i) outer *= axes[i].size;
+
+    std::vector<size_t> index(axes.size(), 0);
+    size_t aPos = 0, bPos = 0, outPos = 0;
+    const double* aData = a.data.data();
+    const double* bData = b.data.data();
+    double* outData = out.data.data();
+    for (size_t n = 0; n < outer; ++n) {
+        if (rowKernel) {
+            kernel(aData + aPos, inner.a == 0, bData + bPos, inner.b == 0, outData + outPos, inner.size);
+        }
+        else {
+            for (size_t i = 0; i < inner.size; ++i) {
+                kernel(aData + aPos + i * inner.a, true, bData + bPos + i * inner.b, true,
+                       outData + outPos + i * inner.out, 1);
+            }
+        }
+        // Advance the outer axes like an odometer
+        for (size_t d = 1; d < axes.size(); ++d) {
+            aPos += axes[d].a;
+            bPos += axes[d].b;
+            outPos += axes[d].out;
+            if (++index[d] < axes[d].size) break;
+            aPos -= axes[d].a * axes[d].size;
+            bPos -= axes[d].b * axes[d].size;
+            outPos -= axes[d].out * axes[d].size;
+            index[d] = 0;
+        }
+    }
+}
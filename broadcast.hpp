@@ -0,0 +1,15 @@
+#pragma once
+
+#include "simd.hpp"
+#include "types.hpp"
+
+// NumPy broadcasting: shapes are aligned on their trailing axes, and along each
+// axis the sizes must match or one of them must be 1. Missing leading axes
+// count as 1. Returns false if the shapes are incompatible.
+bool broadcastShape(const std::vector<size_t>& a, const std::vector<size_t>& b, std::vector<size_t>& out);
+
+// out = kernel(a, b) element by element, where out already has the broadcast
+// shape of a and b. Broadcast axes are read with stride 0, so neither operand
+// is ever expanded; runs of contiguous axes are merged so the kernel sees rows
+// as long as possible. `out` may share its buffer with an operand of its shape.
+void broadcastApply(BinaryKernelFn kernel, const NDArray& a, const NDArray& b, NDArray& out);
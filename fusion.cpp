@@ -0,0 +1,164 @@
+#include "fusion.hpp"
+#include <algorithm>
+
+namespace {
+
+// Deeper chains are cut by computing them, which bounds both the scratch
+// buffers one evaluation needs and the recursion on the way down
+constexpr size_t maxDepth = 32;
+
+// Elements per pass through the tree; a few buffers of this size stay in L1
+constexpr size_t blockSize = 512;
+
+bool isScalar(const std::vector<size_t>& shape) {
+    return shape.size() == 1 && shape[0] == 1;
+}
+
+size_t depthOf(const Value& value) {
+    return value.lazy() ? value.expr().depth : 0;
+}
+
+// Expression tree flattened for evaluation: a node is either a leaf pointing
+// into a computed buffer or an operation on earlier nodes
+struct Node {
+    BinaryKernelFn binary = nullptr;
+    UnaryKernelFn unary = nullptr;
+    size_t left = 0;
+    size_t right = 0;
+    const double* leaf = nullptr;
+    bool scalar = false;
+};
+
+struct Plan {
+    std::vector<Node> nodes;
+    std::vector<std::vector<double>> scratch;
+    std::vector<size_t> shape;  // of the result
+    NDArray output;             // a leaf buffer that can take the result
+    bool hasOutput = false;
+
+    // Adds `value` and its subtree, returning its node index. A shared
+    // subexpression is computed once into its own payload and becomes a leaf,
+    // so other handles to it do not evaluate it again.
+    size_t add(Value& value) {
+        if (value.lazy() && value.unique()) {
+            return add(value.expr());
+        }
+        Node node;
+        if (!hasOutput && value.unique() && value.get<NDArray>().shape == shape && !isScalar(shape)) {
+            // Only this tree can see the buffer, so the result may overwrite it
+            output = std::move(value.mutate<NDArray>());
+            hasOutput = true;
+            node.leaf = output.data.data();
+        }
+        else {
+            const NDArray& arr = value.get<NDArray>();
+            node.leaf = arr.data.data();
+            node.scalar = arr.size() == 1;
+        }
+        nodes.push_back(node);
+        return nodes.size() - 1;
+    }
+
+    size_t add(const LazyExpr& expr) {
+        Node node;
+        node.binary = expr.binary;
+        node.unary = expr.unary;
+        node.left = add(expr.operands[0]);
+        if (expr.binary) node.right = add(expr.operands[1]);
+        nodes.push_back(node);
+        return nodes.size() - 1;
+    }
+
+    // Computes elements [start, start + len) of node `index`. Results go to
+    // `out`; scratch buffers from `level` up are free for the operands. A leaf
+    // returns its own data instead of copying it.
+    const double* run(size_t index, size_t start, size_t len, double* out, size_t level) {
+        const Node& node = nodes[index];
+        if (node.leaf) {
+            return node.scalar ? node.leaf : node.leaf + start;
+        }
+        const double* x = run(node.left, start, len, out, level);
+        if (node.unary) {
+            node.unary(x, out, len);
+            return out;
+        }
+        if (scratch.size() <= level) scratch.emplace_back(blockSize);
+        double* tmp = scratch[level].data();
+        const double* y = run(node.right, start, len, tmp, level + 1);
+        node.binary(x, nodes[node.left].scalar, y, nodes[node.right].scalar, out, len);
+        return out;
+    }
+
+    // Like run, but `out` is written only after every operand has been read,
+    // so it may alias a leaf
+    void runInto(size_t index, size_t start, size_t len, double* out) {
+        const Node& node = nodes[index];
+        for (size_t level = scratch.size(); level < 2; ++level) scratch.emplace_back(blockSize);
+        const double* x = run(node.left, start, len, scratch[0].data(), 2);
+        if (node.unary) {
+            node.unary(x, out, len);
+            return;
+        }
+        const double* y = run(node.right, start, len, scratch[1].data(), 2);
+        node.binary(x, nodes[node.left].scalar, y, nodes[node.right].scalar, out, len);
+    }
+};
+
+}  // namespace
+
+const std::vector<size_t>& denseShape(const Value& value) {
+    return value.lazy() ? value.expr().shape : value.get<NDArray>().shape;
+}
+
+// Leaves are read as flat runs, so strided views are computed eagerly instead
+bool flat(const Value& value) {
+    return value.lazy() || value.get<NDArray>().contiguous();
+}
+
+bool canFuse(const Value& a, const Value& b) {
+    if (std::max(depthOf(a), depthOf(b)) >= maxDepth || !flat(a) || !flat(b)) return false;
+    const std::vector<size_t>& shapeA = denseShape(a);
+    const std::vector<size_t>& shapeB = denseShape(b);
+    if (isScalar(shapeA) && isScalar(shapeB)) return false;
+    return shapeA == shapeB || isScalar(shapeA) || isScalar(shapeB);
+}
+
+bool canFuse(const Value& x) {
+    return depthOf(x) < maxDepth && flat(x) && !isScalar(denseShape(x));
+}
+
+Value fuseBinary(BinaryKernelFn kernel, Value a, Value b) {
+    auto expr = std::make_shared<LazyExpr>();
+    expr->binary = kernel;
+    expr->shape = isScalar(denseShape(a)) ? denseShape(b) : denseShape(a);
+    expr->depth = std::max(depthOf(a), depthOf(b)) + 1;
+    expr->operands.push_back(std::move(a));
+    expr->operands.push_back(std::move(b));
+    return Value(std::shared_ptr<const LazyExpr>(std::move(expr)));
+}
+
+Value fuseUnary(UnaryKernelFn kernel, Value x) {
+    auto expr = std::make_shared<LazyExpr>();
+    expr->unary = kernel;
+    expr->shape = denseShape(x);
+    expr->depth = depthOf(x) + 1;
+    expr->operands.push_back(std::move(x));
+    return Value(std::shared_ptr<const LazyExpr>(std::move(expr)));
+}
+
+NDArray evaluateLazy(const LazyExpr& expr) {
+    Plan plan;
+    plan.shape = expr.shape;
+    size_t root = plan.add(expr);
+    NDArray result = plan.hasOutput ? std::move(plan.output) : NDArray(expr.shape);
+    for (size_t start = 0; start < result.size(); start += blockSize) {
+        size_t len = std::min(blockSize, result.size() - start);
+        if (plan.hasOutput) {
+            plan.runInto(root, start, len, result.data.data() + start);
+        }
+        else {
+            plan.run(root, start, len, result.data.data() + start, 0);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "simd.hpp"
+#include "types.hpp"
+
+// Lazy elementwise fusion. With lazy mode on, arithmetic builtins push a
+// LazyExpr instead of computing; the first builtin that reads the value runs
+// the whole expression tree in one blocked pass, so intermediate results only
+// ever occupy a few cache-sized scratch buffers.
+struct LazyExpr {
+    BinaryKernelFn binary = nullptr;  // set for binary nodes
+    UnaryKernelFn unary = nullptr;    // set for unary nodes
+    // Dense or lazy operands. Mutable because evaluation may take over the
+    // buffer of an operand nothing else refers to.
+    mutable std::vector<Value> operands;
+    std::vector<size_t> shape;
+    size_t depth = 1;
+};
+
+// Shape of a dense or lazy value, without computing it
+const std::vector<size_t>& denseShape(const Value& value);
+
+// Whether `a op b` or `op x` can be deferred. Fusion covers equal shapes and
+// scalar-vs-array; other broadcasts, scalar-only results and chains past the
+// depth limit are computed eagerly.
+bool canFuse(const Value& a, const Value& b);
+bool canFuse(const Value& x);
+
+Value fuseBinary(BinaryKernelFn kernel, Value a, Value b);
+Value fuseUnary(UnaryKernelFn kernel, Value x);
@@ -0,0 +1,484 @@
+// Differential fuzzer built by `make fuzz`. Generates random inputs from a
+// seed and checks the optimized code paths against their reference
+// counterparts:
+//
+//   numbers     parseNumber against std::stod
+//   tokenizer   StreamTokenizer fed a program whole against fed in pieces
+//   kernels     every SIMD variant the host runs against the portable one
+//   programs    random programs with fast paths, lazy fusion and threads on,
+//               against an interpreter using its reference paths on one
+//               thread (see Interpreter::useReferencePaths)
+//
+//   siclang-fuzz [--seed N] [--cases N] [--baseline FILE]
+//                [--slowdown PERCENT] [--case-slowdown PERCENT]
+//
+// Prints a JSON summary on stdout, including each program's run time, and
+// describes every mismatch on stderr. --baseline takes the JSON of an
+// earlier run with the same seed and cases. All programs together taking
+// more than --slowdown (default 20) percent longer than they did then is
+// reported as a slowdown, and so is any one program taking more than
+// --case-slowdown (default 100) percent longer; single programs are short,
+// so their times vary far more than the total. Exits with 1 after any
+// mismatch or slowdown.
+
+#include "interpreter.hpp"
+#include "lexer.hpp"
+#include "simd.hpp"
+#include "tokenizer.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Inputs come only from the seed, so a failing case can be replayed
+class Generator {
+public:
+    explicit Generator(uint64_t seed) : rng(seed) {}
+
+    size_t below(size_t n) { return static_cast<size_t>(rng() % n); }
+    bool chance(size_t percent) { return below(100) < percent; }
+    double real() { return static_cast<double>(rng() >> 11) / 9007199254740992.0; }
+
+    String gap() {
+        static const wchar_t* const gaps[] = {L"", L"", L"", L" ", L"  ", L"\t", L"\n"};
+        return gaps[below(7)];
+    }
+
+    // A number in one of the forms literals use
+    String number() {
+        switch (below(8)) {
+        case 0: return std::to_wstring(below(10));
+        case 1: return L"-" + std::to_wstring(below(100));
+        case 2: return std::to_wstring(below(100)) + L"." + std::to_wstring(below(100));
+        case 3: return std::to_wstring(below(10)) + L"e" + std::to_wstring(below(5));
+        case 4: return L"-" + std::to_wstring(below(10)) + L".5e-" + std::to_wstring(below(3));
+        case 5: return L"." + std::to_wstring(below(100));
+        case 6: return L"+" + std::to_wstring(below(10));
+        default: return std::to_wstring(below(1000));
+        }
+    }
+
+    std::vector<size_t> shape() {
+        if (chance(10)) return {1 + below(40)};
+        std::vector<size_t> dims(1 + below(3));
+        for (size_t& dim : dims) dim = 1 + below(4);
+        return dims;
+    }
+
+    // Array literal of the given shape with irregular spacing. Now and then
+    // a row is one short or long, or a character or string takes the place
+    // of a number, so nested and text arrays come up too.
+    String literal(const std::vector<size_t>& dims, size_t axis = 0) {
+        String text = L"[" + gap();
+        size_t n = dims[axis];
+        if (chance(3)) n = n > 1 && chance(50) ? n - 1 : n + 1;
+        for (size_t i = 0; i < n; ++i) {
+            if (i > 0) text += gap() + L"," + gap();
+            if (axis + 1 < dims.size()) {
+                text += literal(dims, axis + 1);
+            }
+            else if (chance(2)) {
+                text += chance(50) ? L"'x'" : L"\"a b\"";
+            }
+            else {
+                text += number();
+            }
+        }
+        return text + gap() + L"]";
+    }
+
+    String operand() {
+        switch (below(4)) {
+        case 0: return number();
+        case 1: return std::to_wstring(below(20)) + L" range";
+        default: return literal(shape());
+        }
+    }
+
+    // One step of a program: an operand, or a builtin with any extra
+    // operand it takes. Words named in `words` may be called too.
+    String step(const std::vector<String>& words) {
+        static const wchar_t* const plain[] = {L"+", L"-", L"*", L"/", L"^", L"sqrt", L"exp", L"log", L"abs",
+            L"sum", L"max", L"min", L"scan", L"cat", L"swap", L"dup", L"dim", L"transpose", L"matmul",
+            L"dot", L"outer", L"fma"};
+        switch (below(8)) {
+        case 0:
+        case 1:
+        case 2: return operand();
+        case 3: return plain[below(sizeof(plain) / sizeof(plain[0]))];
+        case 4: {
+            static const wchar_t* const counted[] = {L"take", L"drop", L"at"};
+            return std::to_wstring(static_cast<long>(below(7)) - 3) + L" " + counted[below(3)];
+        }
+        case 5:
+            if (chance(50)) {
+                std::vector<size_t> dims = shape();
+                String text = L"[";
+                for (size_t i = 0; i < dims.size(); ++i) text += (i ? L", " : L"") + std::to_wstring(dims[i]);
+                return text + L"] reshape";
+            }
+            return L"[" + std::to_wstring(static_cast<long>(below(9)) - 4) + L", " +
+                   std::to_wstring(static_cast<long>(below(9)) - 4) + L"] slice";
+        case 6:
+            if (!words.empty()) return words[below(words.size())];
+            return plain[below(4)];
+        default: return chance(20) ? L"clear" : L".";
+        }
+    }
+
+    // Statements and short word definitions, then a dump of the stack. Words
+    // only call words defined before them, so every program ends.
+    String program() {
+        std::vector<String> words;
+        String text;
+        for (size_t n = 3 + below(12); n > 0; --n) {
+            if (chance(15)) {
+                String name = L"w" + std::to_wstring(words.size());
+                text += L":" + name;
+                for (size_t i = 1 + below(6); i > 0; --i) text += L" " + step(words);
+                text += L" :end\n";
+                words.push_back(name);
+            }
+            else {
+                text += step(words) + (chance(30) ? L"\n" : L" ");
+            }
+        }
+        return text + L"\n:dump\n";
+    }
+
+    // Text that may or may not start with a number std::stod reads
+    String numeric() {
+        static const wchar_t* const leads[] = {L"", L"", L" ", L"\t"};
+        static const wchar_t* const signs[] = {L"", L"", L"-", L"+"};
+        static const wchar_t* const bodies[] = {L"inf", L"nan", L"INF", L"infinity", L"0x1f", L"0x1.8p3",
+            L"1e400", L"1e-400", L"4.9e-324", L"2.2250738585072014e-308", L"1e", L"e5", L"-", L".", L"0x"};
+        static const wchar_t* const tails[] = {L"", L"", L"x", L" ", L"e", L"e+", L",", L"]"};
+        String text = String(leads[below(4)]) + signs[below(4)];
+        switch (below(5)) {
+        case 0: text += bodies[below(sizeof(bodies) / sizeof(bodies[0]))]; break;
+        case 1: text += std::to_wstring(rng()); break;
+        case 2: text += std::to_wstring(below(1000)) + L"." + std::to_wstring(rng() % 100000); break;
+        case 3: text += L"." + std::to_wstring(below(1000)) + L"e" + std::to_wstring(static_cast<long>(below(700)) - 350); break;
+        default: text += std::to_wstring(below(100)) + L"e" + std::to_wstring(below(30)); break;
+        }
+        return text + tails[below(8)];
+    }
+
+private:
+    std::mt19937_64 rng;
+};
+
+struct Check {
+    const char* name;
+    size_t cases = 0;
+    size_t mismatches = 0;
+};
+
+// Prints what differed, up to a few mismatches per check
+void mismatch(Check& check, size_t index, const String& input, const String& expected, const String& actual) {
+    if (++check.mismatches > 5) return;
+    std::wcerr << L"Mismatch in " << check.name << L" case " << index << L":\n" << input
+               << L"\n--- expected\n" << expected << L"\n--- actual\n" << actual << L"\n\n";
+}
+
+bool sameDouble(double a, double b) {
+    return (std::isnan(a) && std::isnan(b)) || std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+void checkNumbers(Generator& gen, size_t cases, Check& check) {
+    for (size_t i = 0; i < cases; ++i) {
+        String text = gen.numeric();
+        double parsed = 0;
+        bool ok = parseNumber(text, parsed);
+        double expected = 0;
+        bool valid = true;
+        try {
+            expected = std::stod(text);
+        }
+        catch (const std::exception&) {
+            valid = false;
+        }
+        ++check.cases;
+        if (ok != valid || (ok && !sameDouble(parsed, expected))) {
+            mismatch(check, i, text, valid ? std::to_wstring(expected) : L"(no number)",
+                ok ? std::to_wstring(parsed) : L"(no number)");
+        }
+    }
+}
+
+String joined(const std::vector<String>& tokens) {
+    String text;
+    for (const String& token : tokens) text += L"<" + token + L">";
+    return text;
+}
+
+void checkTokenizer(Generator& gen, size_t cases, Check& check) {
+    for (size_t i = 0; i < cases; ++i) {
+        String text = gen.program();
+        TokenList tokens;
+        StreamTokenizer whole;
+        whole.feed(text, true, tokens);
+        std::vector<String> expected(tokens.begin(), tokens.end());
+
+        std::vector<String> actual;
+        StreamTokenizer pieces;
+        for (size_t at = 0; at < text.size() || at == 0;) {
+            size_t n = std::min(text.size() - at, 1 + gen.below(8));
+            tokens.clear();
+            pieces.feed(std::wstring_view(text).substr(at, n), at + n == text.size(), tokens);
+            actual.insert(actual.end(), tokens.begin(), tokens.end());
+            at += n;
+            if (at == text.size()) break;
+        }
+        ++check.cases;
+        if (actual != expected) mismatch(check, i, text, joined(expected), joined(actual));
+    }
+}
+
+void checkKernels(Generator& gen, size_t cases, Check& check) {
+    std::vector<SimdKernels> variants = supportedKernels();
+    const SimdKernels& portable = variants.back();
+    auto fill = [&](std::vector<double>& values) {
+        for (double& v : values) {
+            size_t kind = gen.below(40);
+            v = kind == 0 ? 0.0 : kind == 1 ? -0.0 : kind == 2 ? INFINITY : kind == 3 ? NAN : (gen.real() - 0.5) * 200;
+        }
+    };
+    for (size_t i = 0; i < cases; ++i) {
+        size_t n = gen.below(70);
+        std::vector<double> a(n + 1), b(n + 1), c(n + 1), expected(n), actual(n);
+        fill(a);
+        fill(b);
+        fill(c);
+        bool aScalar = gen.chance(20);
+        bool bScalar = !aScalar && gen.chance(20);
+        bool cScalar = gen.chance(20);
+        for (size_t v = 0; v + 1 < variants.size(); ++v) {
+            const SimdKernels& k = variants[v];
+            const std::pair<BinaryKernelFn, BinaryKernelFn> binary[] = {
+                {portable.add, k.add}, {portable.sub, k.sub}, {portable.mul, k.mul}, {portable.div, k.div}};
+            const std::pair<UnaryKernelFn, UnaryKernelFn> unary[] = {{portable.sqrt, k.sqrt}, {portable.abs, k.abs}};
+            bool same = true;
+            for (auto [reference, fast] : binary) {
+                reference(a.data(), aScalar, b.data(), bScalar, expected.data(), n);
+                fast(a.data(), aScalar, b.data(), bScalar, actual.data(), n);
+                for (size_t j = 0; j < n; ++j) same = same && sameDouble(expected[j], actual[j]);
+            }
+            for (auto [reference, fast] : unary) {
+                reference(a.data(), expected.data(), n);
+                fast(a.data(), actual.data(), n);
+                for (size_t j = 0; j < n; ++j) same = same && sameDouble(expected[j], actual[j]);
+            }
+            portable.fma(a.data(), aScalar, b.data(), bScalar, c.data(), cScalar, expected.data(), n);
+            k.fma(a.data(), aScalar, b.data(), bScalar, c.data(), cScalar, actual.data(), n);
+            for (size_t j = 0; j < n; ++j) same = same && sameDouble(expected[j], actual[j]);
+
+            // The dot kernels add in different orders: infinities and NaNs
+            // must agree, finite sums to within rounding
+            double dotMagnitude = 0.0;
+            for (size_t j = 0; j < n; ++j) dotMagnitude += std::fabs(a[j] * b[j]);
+            double dotExpected = portable.dot(a.data(), b.data(), n), dotActual = k.dot(a.data(), b.data(), n);
+            same = same && (std::isfinite(dotExpected) && std::isfinite(dotMagnitude)
+                                ? std::fabs(dotActual - dotExpected) <= 1e-13 * dotMagnitude
+                                : sameDouble(dotExpected, dotActual));
+
+            // The micro-kernel may fuse multiply-adds, so compare it with a
+            // plain sum to within rounding
+            const GemmKernel& gemm = k.gemm;
+            size_t kc = 1 + gen.below(40);
+            std::vector<double> pa(kc * gemm.rows), pb(kc * gemm.cols);
+            for (double& x : pa) x = gen.real() - 0.5;
+            for (double& x : pb) x = gen.real() - 0.5;
+            std::vector<double> tile(gemm.rows * gemm.cols, 1.0);
+            gemm.micro(kc, pa.data(), pb.data(), tile.data(), gemm.cols);
+            for (size_t r = 0; r < gemm.rows; ++r) {
+                for (size_t col = 0; col < gemm.cols; ++col) {
+                    double sum = 1.0, magnitude = 1.0;
+                    for (size_t step = 0; step < kc; ++step) {
+                        double term = pa[step * gemm.rows + r] * pb[step * gemm.cols + col];
+                        sum += term;
+                        magnitude += std::fabs(term);
+                    }
+                    same = same && std::fabs(tile[r * gemm.cols + col] - sum) <= 1e-13 * magnitude;
+                }
+            }
+
+            ++check.cases;
+            if (!same) {
+                std::wstring name(k.name, k.name + std::strlen(k.name));
+                mismatch(check, i, L"n = " + std::to_wstring(n) + L", kc = " + std::to_wstring(kc), L"portable", name);
+            }
+        }
+    }
+}
+
+struct Run {
+    String out;
+    String errors;
+    double ns;
+};
+
+Run run(const String& program, bool reference) {
+    using Clock = std::chrono::steady_clock;
+    std::wostringstream out, errors;
+    double ns;
+    {
+        Interpreter interp(out, errors, reference ? 1 : 4);
+        if (reference) interp.useReferencePaths();
+        else interp.process(L":lazy on");
+        auto start = Clock::now();
+        interp.process(program);
+        ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+    return {out.str(), errors.str(), ns};
+}
+
+// Fastest of as many runs of `program` as fit in a millisecond, at least
+// five, in one interpreter emptied before each. It has run the program once
+// already, so its threads have started and its caches are warm; noise only
+// ever adds time.
+double fastest(const String& program) {
+    using Clock = std::chrono::steady_clock;
+    std::wostringstream out, errors;
+    Interpreter interp(out, errors, 4);
+    interp.process(L":lazy on");
+    interp.process(program);
+    double best = INFINITY, spent = 0;
+    for (size_t n = 0; n < 5 || spent < 1e6; ++n) {
+        interp.process(L"clear");
+        out.str(String());
+        errors.str(String());
+        auto start = Clock::now();
+        interp.process(program);
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        best = std::min(best, ns);
+        spent += ns;
+    }
+    return best;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    uint64_t seed = 1;
+    size_t cases = 500;
+    const char* baselinePath = nullptr;
+    double slowdown = 20;
+    double caseSlowdown = 100;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--cases") == 0 && i + 1 < argc) {
+            cases = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselinePath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--slowdown") == 0 && i + 1 < argc) {
+            slowdown = std::atof(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--case-slowdown") == 0 && i + 1 < argc) {
+            caseSlowdown = std::atof(argv[++i]);
+        }
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    // Program times from an earlier run, one `{"case": N, "ns": T, ...` per line
+    std::vector<double> baseline;
+    if (baselinePath) {
+        std::ifstream file(baselinePath);
+        if (!file) {
+            std::fprintf(stderr, "Cannot open %s\n", baselinePath);
+            return 2;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t index;
+            double ns;
+            if (std::sscanf(line.c_str(), " {\"case\": %zu, \"ns\": %lf", &index, &ns) == 2) {
+                if (baseline.size() <= index) baseline.resize(index + 1, 0);
+                baseline[index] = ns;
+            }
+        }
+    }
+
+    Generator gen(seed);
+    Check numbers{"numbers"}, tokenizer{"tokenizer"}, kernels{"kernels"}, programs{"programs"};
+    checkNumbers(gen, cases * 4, numbers);
+    checkTokenizer(gen, cases, tokenizer);
+    checkKernels(gen, cases, kernels);
+
+    // Cases shorter than this are too noisy to call slower
+    constexpr double minTimedNs = 20000;
+    struct Timing {
+        double ns;
+        double referenceNs;
+    };
+    std::vector<Timing> timings;
+    std::vector<size_t> slower;
+    double total = 0, baselineTotal = 0;  // over the cases the baseline has
+    for (size_t i = 0; i < cases; ++i) {
+        String program = gen.program();
+        Run expected = run(program, true);
+        Run actual = run(program, false);
+        ++programs.cases;
+        if (actual.out != expected.out || actual.errors != expected.errors) {
+            mismatch(programs, i, program, expected.out + expected.errors, actual.out + actual.errors);
+        }
+        actual.ns = fastest(program);
+        if (i < baseline.size() && baseline[i] > 0) {
+            // The machine itself has slow spells, so a case must stay slower
+            // when measured again
+            double limit = baseline[i] * (1 + caseSlowdown / 100);
+            for (size_t retry = 0; retry < 3 && actual.ns > minTimedNs && actual.ns > limit; ++retry) {
+                actual.ns = std::min(actual.ns, fastest(program));
+            }
+            if (actual.ns > minTimedNs && actual.ns > limit) slower.push_back(i);
+            total += actual.ns;
+            baselineTotal += baseline[i];
+        }
+        timings.push_back({actual.ns, expected.ns});
+    }
+
+    std::printf("{\n  \"seed\": %llu,\n  \"cases\": %zu,\n  \"simd\": \"%s\",\n  \"checks\": {",
+        static_cast<unsigned long long>(seed), cases, simdKernels().name);
+    const Check* checks[] = {&numbers, &tokenizer, &kernels, &programs};
+    for (size_t i = 0; i < 4; ++i) {
+        std::printf("%s\n    \"%s\": {\"cases\": %zu, \"mismatches\": %zu}", i ? "," : "", checks[i]->name,
+            checks[i]->cases, checks[i]->mismatches);
+    }
+    bool slowerOverall = baselineTotal > 0 && total > baselineTotal * (1 + slowdown / 100);
+    std::printf("\n  },\n  \"slower_overall\": %s,\n  \"slowdowns\": [", slowerOverall ? "true" : "false");
+    for (size_t i = 0; i < slower.size(); ++i) {
+        std::printf("%s%zu", i ? ", " : "", slower[i]);
+    }
+    std::printf("],\n  \"programs\": [");
+    for (size_t i = 0; i < timings.size(); ++i) {
+        std::printf("%s\n    {\"case\": %zu, \"ns\": %.0f, \"reference_ns\": %.0f}", i ? "," : "", i, timings[i].ns,
+            timings[i].referenceNs);
+    }
+    std::printf("\n  ]\n}\n");
+
+    for (size_t i : slower) {
+        std::fprintf(stderr, "Slowdown in programs case %zu: %.0f ns, baseline %.0f ns\n", i, timings[i].ns, baseline[i]);
+    }
+    if (slowerOverall) {
+        std::fprintf(stderr, "Slowdown overall: %.0f ns, baseline %.0f ns\n", total, baselineTotal);
+    }
+    bool failed = slowerOverall || !slower.empty();
+    for (const Check* check : checks) failed = failed || check->mismatches > 0;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+#include "gemm.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#if defined(SICLANG_USE_CBLAS)
+#if defined(SICLANG_USE_MKL)
+#include <mkl_cblas.h>
+#else
+#include <cblas.h>
+#endif
+#endif
+
+namespace {
+
+// Below this many multiply-adds the packing overhead outweighs the blocking
+constexpr size_t smallProduct = 32 * 32 * 32;
+
+// Block sizes: a KC x NR sliver of B stays in L1, an MC x KC block of A in L2
+// and a KC x NC panel of B in L3
+constexpr size_t blockK = 256;
+constexpr size_t blockM = 96;
+constexpr size_t blockN = 4080;
+
+void naiveGemm(size_t m, size_t n, size_t k, MatrixView a, MatrixView b, double* c) {
+    for (size_t i = 0; i < m; ++i) {
+        double* row = c + i * n;
+        for (size_t p = 0; p < k; ++p) {
+            double aVal = a.data[i * a.rowStride + p * a.colStride];
+            const double* bRow = b.data + p * b.rowStride;
+            for (size_t j = 0; j < n; ++j) {
+                row[j] += aVal * bRow[j * b.colStride];
+            }
+        }
+    }
+}
+
+// Packs rows [i0, i0 + mc) x columns [p0, p0 + kc) of a into MR-row panels,
+// each stored step by step (MR values per k), zero-padding the last panel
+void packA(MatrixView a, size_t i0, size_t mc, size_t p0, size_t kc, size_t mr, double* out) {
+    for (size_t ir = 0; ir < mc; ir += mr) {
+        size_t rows = std::min(mr, mc - ir);
+        for (size_t p = 0; p < kc; ++p) {
+            const double* col = a.data + (p0 + p) * a.colStride + (i0 + ir) * a.rowStride;
+            for (size_t r = 0; r < rows; ++r) *out++ = col[r * a.rowStride];
+            for (size_t r = rows; r < mr; ++r) *out++ = 0.0;
+        }
+    }
+}
+
+// Packs rows [p0, p0 + kc) x columns [j0, j0 + nc) of b into NR-column panels
+void packB(MatrixView b, size_t p0, size_t kc, size_t j0, size_t nc, size_t nr, double* out) {
+    for (size_t jr = 0; jr < nc; jr += nr) {
+        size_t cols = std::min(nr, nc - jr);
+        for (size_t p = 0; p < kc; ++p) {
+            const double* row = b.data + (p0 + p) * b.rowStride + (j0 + jr) * b.colStride;
+            for (size_t j = 0; j < cols; ++j) *out++ = row[j * b.colStride];
+            for (size_t j = cols; j < nr; ++j) *out++ = 0.0;
+        }
+    }
+}
+
+// Runs the micro-kernel over one packed mc x kc block of A and kc x nc panel
+// of B. Partial tiles at the edges go through a scratch tile so the kernel
+// can always load and store a full MR x NR block.
+void macroKernel(const GemmKernel& kernel, size_t mc, size_t nc, size_t kc,
+                 const double* packedA, const double* packedB, double* c, size_t ldc) {
+    size_t mr = kernel.rows, nr = kernel.cols;
+    std::vector<double> tile(mr * nr);
+    for (size_t jr = 0; jr < nc; jr += nr) {
+        size_t cols = std::min(nr, nc - jr);
+        const double* bPanel = packedB + jr * kc;
+        for (size_t ir = 0; ir < mc; ir += mr) {
+            size_t rows = std::min(mr, mc - ir);
+            const double* aPanel = packedA + ir * kc;
+            double* cTile = c + ir * ldc + jr;
+            if (rows == mr && cols == nr) {
+                kernel.micro(kc, aPanel, bPanel, cTile, ldc);
+                continue;
+            }
+            for (size_t r = 0; r < mr; ++r) {
+                for (size_t j = 0; j < nr; ++j) {
+                    tile[r * nr + j] = (r < rows && j < cols) ? cTile[r * ldc + j] : 0.0;
+                }
+            }
+            kernel.micro(kc, aPanel, bPanel, tile.data(), nr);
+            for (size_t r = 0; r < rows; ++r) {
+                std::copy_n(&tile[r * nr], cols, cTile + r * ldc);
+            }
+        }
+    }
+}
+
+void blockedGemm(size_t m, size_t n, size_t k, MatrixView a, MatrixView b, double* c, ThreadPool& pool) {
+    const GemmKernel& kernel = simdKernels().gemm;
+    size_t mr = kernel.rows, nr = kernel.cols;
+
+    // Shrink the row block when that is what it takes to keep every thread busy
+    size_t mc = std::max(mr, blockM / mr * mr);
+    size_t perThread = (m + pool.size() - 1) / pool.size();
+    mc = std::min(mc, std::max(mr, (perThread + mr - 1) / mr * mr));
+    size_t ncMax = std::max(nr, blockN / nr * nr);
+
+    std::vector<double> packedB;
+    for (size_t jc = 0; jc < n; jc += ncMax) {
+        size_t nc = std::min(ncMax, n - jc);
+        for (size_t pc = 0; pc < k; pc += blockK) {
+            size_t kc = std::min(blockK, k - pc);
+            packedB.resize((nc + nr - 1) / nr * nr * kc);
+            packB(b, pc, kc, jc, nc, nr, packedB.data());
+
+            // Each row block writes its own rows of c, so blocks run independently
+            size_t rowBlocks = (m + mc - 1) / mc;
+            pool.parallelFor(rowBlocks, [&](size_t block) {
+                thread_local std::vector<double> packedA;
+                size_t ic = block * mc;
+                size_t rows = std::min(mc, m - ic);
+                packedA.resize((rows + mr - 1) / mr * mr * kc);
+                packA(a, ic, rows, pc, kc, mr, packedA.data());
+                macroKernel(kernel, rows, nc, kc, packedA.data(), packedB.data(), c + ic * n + jc, n);
+            });
+        }
+    }
+}
+
+#if defined(SICLANG_USE_CBLAS)
+// Describes a view to BLAS as a (possibly transposed) row-major matrix, or
+// copies it into one when neither stride is unit
+CBLAS_TRANSPOSE blasLayout(MatrixView view, size_t rows, size_t cols, std::vector<double>& copy,
+                           const double*& data, size_t& ld) {
+    if (view.colStride == 1 && view.rowStride >= std::max<size_t>(1, cols)) {
+        data = view.data;
+        ld = view.rowStride;
+        return CblasNoTrans;
+    }
+    if (view.rowStride == 1 && view.colStride >= std::max<size_t>(1, rows)) {
+        data = view.data;
+        ld = view.colStride;
+        return CblasTrans;
+    }
+    copy.resize(rows * cols);
+    for (size_t i = 0; i < rows; ++i) {
+        for (size_t j = 0; j < cols; ++j) {
+            copy[i * cols + j] = view.data[i * view.rowStride + j * view.colStride];
+        }
+    }
+    data = copy.data();
+    ld = std::max<size_t>(1, cols);
+    return CblasNoTrans;
+}
+#endif
+
+}  // namespace
+
+void gemm(size_t m, size_t n, size_t k, MatrixView a, MatrixView b, double* c, ThreadPool& pool) {
+    if (m == 0 || n == 0 || k == 0) return;
+    if (m * n * k <= smallProduct) {
+        naiveGemm(m, n, k, a, b, c);
+        return;
+    }
+#if defined(SICLANG_USE_CBLAS)
+    // BLAS takes int dimensions; anything larger stays on the built-in path
+    if (std::max({m, n, k}) <= static_cast<size_t>(INT_MAX)) {
+        std::vector<double> copyA, copyB;
+        const double* dataA;
+        const double* dataB;
+        size_t lda, ldb;
+        CBLAS_TRANSPOSE transA = blasLayout(a, m, k, copyA, dataA, lda);
+        CBLAS_TRANSPOSE transB = blasLayout(b, k, n, copyB, dataB, ldb);
+        cblas_dgemm(CblasRowMajor, transA, transB, static_cast<int>(m), static_cast<int>(n), static_cast<int>(k),
+                    1.0, dataA, static_cast<int>(lda), dataB, static_cast<int>(ldb), 1.0, c, static_cast<int>(n));
+        return;
+    }
+#endif
+    blockedGemm(m, n, k, a, b, c, pool);
+}
+
+void outer(size_t m, size_t n, const double* a, const double* b, double* c, ThreadPool& pool) {
+    if (m == 0 || n == 0) return;
+    BinaryKernelFn mul = simdKernels().mul;
+    size_t rows = std::max<size_t>(1, smallProduct / n);
+    pool.parallelFor((m + rows - 1) / rows, [&](size_t block) {
+        size_t end = std::min(m, (block + 1) * rows);
+        for (size_t i = block * rows; i < end; ++i) mul(a + i, true, b, false, c + i * n, n);
+    });
+}
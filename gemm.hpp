@@ -0,0 +1,21 @@
+#pragma once
+
+#include "threadpool.hpp"
+#include <cstddef>
+
+// Read-only strided view of a matrix; strides are counted in elements
+struct MatrixView {
+    const double* data;
+    size_t rowStride;
+    size_t colStride;
+};
+
+// c (contiguous m x n, row-major) += a (m x k) * b (k x n). Large products are
+// cache-blocked around the SIMD micro-kernel and split across the pool; a
+// build with SICLANG_USE_CBLAS hands them to the system BLAS instead.
+void gemm(size_t m, size_t n, size_t k, MatrixView a, MatrixView b, double* c, ThreadPool& pool);
+
+// c (contiguous m x n) = the outer product of contiguous vectors a (m) and b
+// (n): each row is b scaled by one element of a, through the SIMD multiply
+// kernel, with blocks of rows split across the pool
+void outer(size_t m, size_t n, const double* a, const double* b, double* c, ThreadPool& pool);
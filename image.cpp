@@ -0,0 +1,383 @@
+#include "image.hpp"
+#include "arrayfile.hpp"
+#include "view.hpp"
+#include <cstring>
+#include <cwchar>
+#include <fstream>
+
+namespace {
+
+constexpr char magic[8] = {'S', 'I', 'C', 'I', 'M', 'A', 'G', 'E'};
+constexpr uint32_t version = 1;
+constexpr uint32_t lazyBit = 1, summaryBit = 2;
+
+// Deepest nesting of arrays or word bodies a file may contain
+constexpr size_t maxNesting = 4096;
+
+// Value and element tags
+enum : uint8_t { NumberTag, DenseTag, NestedTag, TextTag };
+enum : uint8_t { WCharTag, DoubleTag, StringTag, ArrayTag };
+
+class Writer {
+public:
+    explicit Writer(std::ofstream& file) : file(file) {}
+
+    void bytes(const void* from, size_t count) {
+        file.write(static_cast<const char*>(from), static_cast<std::streamsize>(count));
+        offset += count;
+    }
+    template <typename T> void put(T value) { bytes(&value, sizeof value); }
+    void align() {
+        static constexpr char zeros[8] = {};
+        bytes(zeros, (8 - offset % 8) % 8);
+    }
+
+    // Characters are stored as uint32, whatever the size of wchar_t
+    void string(std::wstring_view text) {
+        put(static_cast<uint32_t>(text.size()));
+        for (wchar_t c : text) put(static_cast<uint32_t>(c));
+    }
+
+    void array(const Array& arr) {
+        put(static_cast<uint32_t>(arr.size()));
+        for (const Element& el : arr) {
+            if (const wchar_t* c = std::get_if<wchar_t>(&el)) {
+                put(WCharTag);
+                put(static_cast<uint32_t>(*c));
+            }
+            else if (const double* d = std::get_if<double>(&el)) {
+                put(DoubleTag);
+                put(*d);
+            }
+            else if (const String* s = std::get_if<String>(&el)) {
+                put(StringTag);
+                string(*s);
+            }
+            else {
+                put(ArrayTag);
+                array(std::get<Array>(el));
+            }
+        }
+    }
+
+    // Lazy values are written as the array they compute
+    void value(const Value& v) {
+        if (v.scalar()) {
+            put(NumberTag);
+            put(v.number());
+        }
+        else if (v.holds<NDArray>()) {
+            NDArray packed = v.get<NDArray>().contiguous() ? NDArray() : compact(v.get<NDArray>());
+            const NDArray& arr = packed.rank() ? packed : v.get<NDArray>();
+            put(DenseTag);
+            put(static_cast<uint32_t>(arr.rank()));
+            for (size_t dim : arr.shape) put(static_cast<uint64_t>(dim));
+            align();
+            bytes(arr.data.data(), arr.size() * 8);
+        }
+        else if (v.holds<Text>()) {
+            const Text& text = v.get<Text>();
+            put(TextTag);
+            put(static_cast<uint8_t>(text.characters()));
+            put(static_cast<uint32_t>(text.size()));
+            for (size_t i = 0; i < text.size(); ++i) {
+                if (text.characters()) {
+                    put(static_cast<uint32_t>(text[i][0]));
+                }
+                else {
+                    string(text[i]);
+                }
+            }
+        }
+        else {
+            put(NestedTag);
+            array(v.get<Array>());
+        }
+    }
+
+    void code(const Code& c) {
+        put(static_cast<uint32_t>(c.instructions.size()));
+        for (const Instruction& ins : c.instructions) {
+            put(static_cast<uint32_t>(ins.op));
+            put(ins.arg);
+            put(ins.alt);
+        }
+        put(static_cast<uint32_t>(c.constants.size()));
+        for (const Value& v : c.constants) value(v);
+        put(static_cast<uint32_t>(c.bodies.size()));
+        for (const auto& body : c.bodies) code(*body);
+        put(static_cast<uint32_t>(c.messages.size()));
+        for (const String& message : c.messages) string(message);
+    }
+
+private:
+    std::ofstream& file;
+    uint64_t offset = 0;
+};
+
+// Bounds-checked cursor over a mapped image. Any read past the end or any
+// inconsistent field clears `ok`; callers check it once at the end.
+class Reader {
+public:
+    Reader(const MappedFile& file, SymbolTable& symbols) : file(file), symbols(symbols) {}
+
+    bool ok = true;
+    std::vector<uint32_t> ids;  // id in `symbols` of each symbol in the file
+
+    template <typename T> T get() {
+        T value{};
+        if (ok && file.size - pos >= sizeof value) {
+            std::memcpy(&value, file.bytes + pos, sizeof value);
+            pos += sizeof value;
+        }
+        else {
+            ok = false;
+        }
+        return value;
+    }
+
+    // A count of items at least `itemSize` bytes each, checked against what
+    // is left so a corrupt count cannot trigger a huge allocation
+    uint32_t count(size_t itemSize) {
+        uint32_t n = get<uint32_t>();
+        if (ok && n > (file.size - pos) / itemSize) ok = false;
+        return ok ? n : 0;
+    }
+
+    bool atEnd() const { return pos == file.size; }
+
+    // A Unicode scalar value that fits wchar_t
+    wchar_t character() {
+        uint32_t c = get<uint32_t>();
+        if (c > 0x10FFFF || (c >= 0xD800 && c < 0xE000) || c > uint32_t(WCHAR_MAX)) ok = false;
+        return ok ? static_cast<wchar_t>(c) : L'\0';
+    }
+
+    String string() {
+        uint32_t n = count(4);
+        String text(n, L'\0');
+        for (uint32_t i = 0; i < n; ++i) text[i] = character();
+        return text;
+    }
+
+    Array array(size_t depth) {
+        Array arr;
+        uint32_t n = count(1);
+        if (depth > maxNesting) ok = false;
+        for (uint32_t i = 0; i < n && ok; ++i) {
+            switch (get<uint8_t>()) {
+            case WCharTag: arr.push_back(character()); break;
+            case DoubleTag: arr.push_back(get<double>()); break;
+            case StringTag: arr.push_back(string()); break;
+            case ArrayTag: arr.push_back(array(depth + 1)); break;
+            default: ok = false;
+            }
+        }
+        return arr;
+    }
+
+    // Dense elements are not copied: the array borrows the mapped bytes
+    Value value() {
+        switch (get<uint8_t>()) {
+        case NumberTag:
+            return get<double>();
+        case DenseTag: {
+            uint32_t rank = count(8);
+            std::vector<size_t> shape(rank);
+            size_t size = 1;
+            for (size_t& dim : shape) {
+                uint64_t d = get<uint64_t>();
+                if (d != 0 && size > (file.size / 8) / d) ok = false;
+                dim = static_cast<size_t>(d);
+                size *= dim;
+            }
+            pos += (8 - pos % 8) % 8;
+            if (!ok || rank == 0 || pos > file.size || (file.size - pos) / 8 < size) {
+                ok = false;
+                return 0.0;
+            }
+            NDArray arr;
+            arr.reshape(shape);
+            arr.data = Buffer(file.keepAlive, reinterpret_cast<double*>(file.bytes + pos), size);
+            pos += size * 8;
+            return arr;
+        }
+        case NestedTag:
+            return array(0);
+        case TextTag: {
+            bool characters = get<uint8_t>() != 0;
+            Text text(characters);
+            for (uint32_t i = 0, n = count(4); i < n && ok; ++i) {
+                if (characters) {
+                    text.push(character());
+                }
+                else {
+                    text.push(string());
+                }
+            }
+            return text;
+        }
+        default:
+            ok = false;
+            return 0.0;
+        }
+    }
+
+    // Code whose symbol ids are rewritten to the table's own; every index an
+    // instruction carries is checked so the interpreter can trust it
+    std::shared_ptr<const Code> code(size_t depth) {
+        auto c = std::make_shared<Code>();
+        c->instructions.resize(count(12));
+        for (Instruction& ins : c->instructions) {
+            uint32_t op = get<uint32_t>();
+            ins.op = static_cast<OpCode>(op);
+            ins.arg = get<uint32_t>();
+            ins.alt = get<uint32_t>();
+            if (op > static_cast<uint32_t>(OpCode::Memory)) ok = false;
+        }
+        for (uint32_t i = 0, n = count(1); i < n && ok; ++i) c->constants.push_back(value());
+        if (depth > maxNesting) ok = false;
+        for (uint32_t i = 0, n = count(4); i < n && ok; ++i) c->bodies.push_back(code(depth + 1));
+        for (uint32_t i = 0, n = count(4); i < n && ok; ++i) c->messages.push_back(string());
+
+        for (Instruction& ins : c->instructions) {
+            if (!ok) break;
+            switch (ins.op) {
+            case OpCode::PushConst:
+                ok = ins.arg < c->constants.size();
+                break;
+            case OpCode::CallBuiltin:
+                // Builtin numbers differ between builds; look it up by name
+                ok = builtin(ins.alt);
+                if (ok) {
+                    ins.alt = ids[ins.alt];
+                    ins.arg = symbols[ins.alt].builtin;
+                }
+                break;
+            case OpCode::CallWordOrBuiltin:
+                ok = builtin(ins.arg);
+                if (ok) ins.arg = ids[ins.arg];
+                break;
+            case OpCode::CallWordOrPush:
+                ok = symbol(ins.arg) && ins.alt < c->constants.size();
+                if (ok) ins.arg = ids[ins.arg];
+                break;
+            case OpCode::DefineWord:
+                ok = symbol(ins.arg) && ins.alt < c->bodies.size();
+                if (ok) ins.arg = ids[ins.arg];
+                break;
+            case OpCode::Profile:
+            case OpCode::Memory:
+                ok = ins.alt == UINT32_MAX || ins.alt < c->messages.size();
+                break;
+            case OpCode::SaveImage:
+            case OpCode::ReportError:
+                ok = ins.arg < c->messages.size();
+                break;
+            default:
+                break;
+            }
+        }
+        return c;
+    }
+
+    bool symbol(uint32_t fileId) const { return fileId < ids.size(); }
+
+    // Whether the symbol names a builtin of this build
+    bool builtin(uint32_t fileId) {
+        if (!symbol(fileId)) return false;
+        if (symbols[ids[fileId]].builtin == Symbol::noBuiltin) {
+            unknownBuiltin = symbols.name(ids[fileId]);
+            return false;
+        }
+        return true;
+    }
+
+    String unknownBuiltin;  // set when the image calls a builtin this build lacks
+
+private:
+    const MappedFile& file;
+    SymbolTable& symbols;
+    size_t pos = 0;
+};
+
+}  // namespace
+
+bool saveImage(const std::filesystem::path& path, const SymbolTable& symbols, const Image& image, String& error) {
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            error = L"Cannot write " + path.wstring();
+            return false;
+        }
+        Writer out(file);
+        out.bytes(magic, sizeof magic);
+        out.put(version);
+        out.put((image.lazyMode ? lazyBit : 0) | (image.summaryMode ? summaryBit : 0));
+        out.put(static_cast<uint32_t>(symbols.size()));
+        for (uint32_t id = 0; id < symbols.size(); ++id) out.string(symbols.name(id));
+        out.put(static_cast<uint32_t>(image.words.size()));
+        for (const auto& [id, source] : image.words) {
+            out.put(id);
+            out.code(*source);
+        }
+        out.put(static_cast<uint32_t>(image.stack.size()));
+        for (const Value& value : image.stack) out.value(value);
+        if (!file.flush()) {
+            error = L"Cannot write " + path.wstring();
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp, ec);
+        error = L"Cannot write " + path.wstring();
+        return false;
+    }
+    return true;
+}
+
+bool loadImage(const std::filesystem::path& path, SymbolTable& symbols, Image& image, String& error) {
+    MappedFile file;
+    if (!mapFile(path, file, error)) return false;
+    if (file.size < 16 || std::memcmp(file.bytes, magic, sizeof magic) != 0) {
+        error = path.wstring() + L" is not an image file";
+        return false;
+    }
+
+    Reader in(file, symbols);
+    in.get<uint64_t>();
+    if (in.get<uint32_t>() != version) {
+        error = path.wstring() + L" was saved by an incompatible version";
+        return false;
+    }
+    uint32_t modes = in.get<uint32_t>();
+    image = Image();
+    image.lazyMode = modes & lazyBit;
+    image.summaryMode = modes & summaryBit;
+
+    for (uint32_t i = 0, n = in.count(4); i < n && in.ok; ++i) {
+        String name = in.string();
+        in.ids.push_back(symbols.intern(name));
+    }
+    for (uint32_t i = 0, n = in.count(16); i < n && in.ok; ++i) {
+        uint32_t id = in.get<uint32_t>();
+        std::shared_ptr<const Code> source = in.code(0);
+        if (!in.symbol(id)) in.ok = false;
+        if (in.ok) image.words.emplace_back(in.ids[id], std::move(source));
+    }
+    for (uint32_t i = 0, n = in.count(5); i < n && in.ok; ++i) image.stack.push(in.value());
+
+    if (!in.unknownBuiltin.empty()) {
+        error = path.wstring() + L" calls " + in.unknownBuiltin + L", which is not a builtin";
+        return false;
+    }
+    if (!in.ok || !in.atEnd()) {
+        error = path.wstring() + L" is not an image file";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "types.hpp"
+#include <filesystem>
+
+// Interpreter images, as written by `:save-image FILE` and read by
+// `siclang --image FILE`: the words a session defined, its modes and its
+// stack, so a later run can start from them without re-running the scripts
+// that built them.
+//
+//   offset 0   8 bytes    magic "SICIMAGE"
+//   offset 8   uint32     format version
+//   offset 12  uint32     modes; bit 0 lazy, bit 1 summary
+//   then                  every symbol name, in id order
+//   then                  the defined words: symbol id and compiled source
+//   then                  the stack, bottom first
+//
+// Like array files, fields use the host's byte order and dense elements are
+// aligned to 8 bytes, so loading maps the file and arrays borrow its pages.
+
+struct Image {
+    std::vector<std::pair<uint32_t, std::shared_ptr<const Code>>> words;  // symbol id and source
+    Stack stack;
+    bool lazyMode = false;
+    bool summaryMode = false;
+};
+
+// Writes `image`, whose code refers to ids in `symbols`, through a temporary
+// file that replaces `path` once complete. On failure returns false and sets
+// `error`.
+bool saveImage(const std::filesystem::path& path, const SymbolTable& symbols, const Image& image, String& error);
+
+// Reads an image, interning its names into `symbols` and rewriting the code
+// to use their ids there. Builtin calls are bound by name, so an image stays
+// valid across builds that add builtins.
+bool loadImage(const std::filesystem::path& path, SymbolTable& symbols, Image& image, String& error);
@@ -1,39 +1,53 @@
 #include "interpreter.hpp"
+#include "lexer.hpp"
+#include "kernels.hpp"
+#include "gemm.hpp"
+#include "broadcast.hpp"
+#include "fusion.hpp"
+#include "reduce.hpp"
+#include "arrayfile.hpp"
+#include "image.hpp"
+#include "view.hpp"
 #include <cmath>
+#include <tuple>
+#include <utility>
 
 // Implementation of Interpreter class methods
-bool Interpreter::isNumber(const String& token) {
-    try {
-        std::stod(token);
-        return true;
-    }
-    catch (...) {
-        return false;
-    }
+bool Interpreter::isNumber(std::wstring_view token) {
+    double value;
+    return parseNumber(token, value);
 }
 
-bool Interpreter::isWChar(const String& token) {
+bool Interpreter::isWChar(std::wstring_view token) {
     return token.length() == 1 && !isNumber(token);
 }
 
-bool Interpreter::isStringLiteral(const String& token) {
+bool Interpreter::isStringLiteral(std::wstring_view token) {
     return token.length() >= 2 && token.front() == L'"' && token.back() == L'"';
 }
 
-bool Interpreter::isArrayLiteral(const String& token) {
+bool Interpreter::isArrayLiteral(std::wstring_view token) {
     return token.length() >= 2 && token.front() == L'[' && token.back() == L']';
 }
 
-bool Interpreter::isFunctionName(const String& token) {
+bool Interpreter::isFunctionName(std::wstring_view token) {
     if (token.empty() || token == L":end" || token == L":dump") return false;
     return std::all_of(token.begin(), token.end(), [](wchar_t c) {
         return std::iswalnum(c) || c == L'_' || c > 127;
     });
 }
 
-std::vector<String> Interpreter::parseArrayTokens(const String& input) {
-    std::vector<String> tokens;
-    String current;
+// Splits the inside of an array literal at top-level commas. The pieces are
+// trimmed views into `input`, held in the line arena.
+TokenList Interpreter::parseArrayTokens(std::wstring_view input) {
+    TokenList tokens(&lineArena);
+    auto addTrimmed = [&](std::wstring_view piece) {
+        size_t first = piece.find_first_not_of(L" \t");
+        if (first != std::wstring_view::npos) {
+            tokens.push_back(piece.substr(first, piece.find_last_not_of(L" \t") + 1 - first));
+        }
+    };
+    size_t start = 1;
     int bracketDepth = 0;
     bool inQuotes = false;
 
@@ -41,78 +55,139 @@ std::vector<String> Interpreter::parseArrayTokens(const String& input) {
         wchar_t c = input[i];
         if (c == L'"' && (i == 0 || input[i - 1] != L'\\')) {
             inQuotes = !inQuotes;
-            current += c;
             continue;
         }
         if (inQuotes) {
-            current += c;
             continue;
         }
         if (c == L'[') {
             bracketDepth++;
-            current += c;
             continue;
         }
         if (c == L']') {
             bracketDepth--;
-            current += c;
             continue;
         }
         if (c == L',' && bracketDepth == 0) {
-            current.erase(0, current.find_first_not_of(L" \t"));
-            current.erase(current.find_last_not_of(L" \t") + 1);
-            if (!current.empty()) {
-                tokens.push_back(current);
-            }
-            current.clear();
-            continue;
+            addTrimmed(input.substr(start, i - start));
+            start = i + 1;
         }
-        current += c;
-    }
-    current.erase(0, current.find_first_not_of(L" \t"));
-    current.erase(current.find_last_not_of(L" \t") + 1);
-    if (!current.empty()) {
-        tokens.push_back(current);
     }
+    addTrimmed(input.substr(start, input.length() - 1 - start));
     return tokens;
 }
 
-Element Interpreter::parseElement(const String& token) {
-    if (isNumber(token)) {
-        return std::stod(token);
+Element Interpreter::parseElement(std::wstring_view token) {
+    double number;
+    if (parseNumber(token, number)) {
+        return number;
     }
     else if (isStringLiteral(token)) {
-        return token.substr(1, token.length() - 2);
+        return String(token.substr(1, token.length() - 2));
     }
-    else if (isWChar(token)) {
+    else if (token.length() == 1) {
         return token[0];
     }
     else if (isArrayLiteral(token)) {
         return parseArray(token);
     }
-    return token;
+    return String(token);
 }
 
-Array Interpreter::parseArray(const String& token) {
+Array Interpreter::parseArray(std::wstring_view token) {
     Array result;
     if (!isArrayLiteral(token)) {
         result.push_back(parseElement(token));
         return result;
     }
 
-    std::vector<String> elements = parseArrayTokens(token);
-    for (const auto& elem : elements) {
+    for (std::wstring_view elem : parseArrayTokens(token)) {
         result.push_back(parseElement(elem));
     }
     return result;
 }
 
+// Single pass over a quote-free array literal that lexes numbers in place and
+// writes them straight into a dense buffer. It splits and classifies elements
+// exactly like parseArrayTokens and parseElement, and gives up (returning false)
+// on anything that would not end up as a dense NDArray.
+bool Interpreter::parseDenseLiteral(std::wstring_view token, NDArray& out) {
+    if (!isArrayLiteral(token) || token.find(L'"') != std::wstring_view::npos) return false;
+
+    std::vector<size_t> shape;
+    std::pmr::vector<double> data(Buffer::allocator());
+    size_t rank = 0;
+
+    std::function<bool(const wchar_t*, const wchar_t*, size_t)> parseLevel =
+        [&](const wchar_t* first, const wchar_t* last, size_t depth) -> bool {
+        size_t count = 0;
+        auto element = [&](const wchar_t* b, const wchar_t* e) -> bool {
+            while (b != e && (*b == L' ' || *b == L'\t')) ++b;
+            while (e != b && (e[-1] == L' ' || e[-1] == L'\t')) --e;
+            if (b == e) return true;
+            ++count;
+            double number;
+            if (parseNumber(b, e, number)) {
+                if (rank == 0) rank = depth + 1;
+                if (rank != depth + 1) return false;
+                data.push_back(number);
+                return true;
+            }
+            if (e - b >= 2 && *b == L'[' && e[-1] == L']') {
+                if (rank != 0 && rank <= depth + 1) return false;
+                return parseLevel(b, e, depth + 1);
+            }
+            return false;
+        };
+
+        int bracketDepth = 0;
+        const wchar_t* start = first + 1;
+        for (const wchar_t* c = first + 1; c < last - 1; ++c) {
+            if (*c == L'[') bracketDepth++;
+            else if (*c == L']') bracketDepth--;
+            else if (*c == L',' && bracketDepth == 0) {
+                if (!element(start, c)) return false;
+                start = c + 1;
+            }
+        }
+        if (!element(start, last - 1) || count == 0) return false;
+
+        if (shape.size() <= depth) shape.resize(depth + 1, 0);
+        if (shape[depth] == 0) shape[depth] = count;
+        return shape[depth] == count;
+    };
+
+    if (!parseLevel(token.data(), token.data() + token.size(), 0) || shape.size() != rank) return false;
+    out.reshape(shape);
+    out.data = std::move(data);
+    return true;
+}
+
+Value Interpreter::parseValue(std::wstring_view token) {
+    NDArray dense;
+    double number;
+    if (parseNumber(token, number)) {
+        return number;
+    }
+    if (!reference && parseDenseLiteral(token, dense)) {
+        return dense;
+    }
+    if (isStringLiteral(token)) {
+        Text text(false);
+        text.push(token.substr(1, token.length() - 2));
+        return text;
+    }
+    Value value = parseArray(token);
+    if (!makeDense(value)) makeText(value);
+    return value;
+}
+
 void Interpreter::printArray(const Array& arr, int indent) {
-    std::wcout << std::wstring(indent * 2, L' ');
-    std::wcout << L"[";
+    output.indent(indent);
+    output.put(L'[');
 
     if (arr.empty()) {
-        std::wcout << L"]";
+        output.put(L']');
         return;
     }
 
@@ -125,30 +200,36 @@ void Interpreter::printArray(const Array& arr, int indent) {
     }
 
     if (isNested) {
-        std::wcout << L"\n";
+        output.put(L'\n');
         for (size_t i = 0; i < arr.size(); ++i) {
             std::visit([&](const auto& value) {
                 if constexpr (std::is_same_v<std::decay_t<decltype(value)>, Array>) {
                     printArray(value, indent + 1);
                 }
                 else if constexpr (std::is_same_v<std::decay_t<decltype(value)>, double>) {
-                    std::wcout << std::wstring((indent + 1) * 2, L' ') << value;
+                    output.indent(indent + 1);
+                    output.put(value);
                 }
                 else if constexpr (std::is_same_v<std::decay_t<decltype(value)>, wchar_t>) {
-                    std::wcout << std::wstring((indent + 1) * 2, L' ') << value;
+                    output.indent(indent + 1);
+                    output.put(value);
                 }
                 else if constexpr (std::is_same_v<std::decay_t<decltype(value)>, String>) {
-                    std::wcout << std::wstring((indent + 1) * 2, L' ') << L"\"" << value << L"\"";
+                    output.indent(indent + 1);
+                    output.put(L'"');
+                    output.put(value);
+                    output.put(L'"');
                 }
             }, arr[i]);
             if (i < arr.size() - 1) {
-                std::wcout << L",\n";
+                output.put(L",\n");
             }
             else {
-                std::wcout << L"\n";
+                output.put(L'\n');
             }
         }
-        std::wcout << std::wstring(indent * 2, L' ') << L"]";
+        output.indent(indent);
+        output.put(L']');
     }
     else {
         for (size_t i = 0; i < arr.size(); ++i) {
@@ -157,20 +238,108 @@ void Interpreter::printArray(const Array& arr, int indent) {
                     printArray(value, indent);
                 }
                 else if constexpr (std::is_same_v<std::decay_t<decltype(value)>, double>) {
-                    std::wcout << value;
+                    output.put(value);
                 }
                 else if constexpr (std::is_same_v<std::decay_t<decltype(value)>, wchar_t>) {
-                    std::wcout << value;
+                    output.put(value);
                 }
                 else if constexpr (std::is_same_v<std::decay_t<decltype(value)>, String>) {
-                    std::wcout << L"\"" << value << L"\"";
+                    output.put(L'"');
+                    output.put(value);
+                    output.put(L'"');
                 }
             }, arr[i]);
             if (i < arr.size() - 1) {
-                std::wcout << L" ";
+                output.put(L' ');
+            }
+        }
+        output.put(L']');
+    }
+}
+
+void Interpreter::printArray(const NDArray& arr, int indent) {
+    printDense(arr, 0, 0, indent, summaryMode && arr.size() > summaryThreshold);
+}
+
+// Prints the sub-array along `axis` starting at `offset`, laid out exactly like
+// printArray does for the equivalent nested Array. With `summarize`, long axes
+// show only their first and last summaryEdge entries around a "...".
+void Interpreter::printDense(const NDArray& arr, size_t axis, size_t offset, int indent, bool summarize) {
+    output.indent(indent);
+    output.put(L'[');
+
+    size_t n = arr.shape[axis];
+    if (n == 0) {
+        output.put(L']');
+        return;
+    }
+    bool elide = summarize && n > 2 * summaryEdge;
+
+    if (axis + 1 < arr.rank()) {
+        output.put(L'\n');
+        for (size_t i = 0; i < n; ++i) {
+            if (elide && i == summaryEdge) {
+                output.indent(indent + 1);
+                output.put(L"...,\n");
+                i = n - summaryEdge;
+            }
+            printDense(arr, axis + 1, offset + i * arr.strides[axis], indent + 1, summarize);
+            if (i < n - 1) {
+                output.put(L",\n");
+            }
+            else {
+                output.put(L'\n');
+            }
+        }
+        output.indent(indent);
+        output.put(L']');
+    }
+    else {
+        for (size_t i = 0; i < n; ++i) {
+            if (elide && i == summaryEdge) {
+                output.put(L"... ");
+                i = n - summaryEdge;
+            }
+            output.put(arr.data[offset + i * arr.strides[axis]]);
+            if (i < n - 1) {
+                output.put(L' ');
             }
         }
-        std::wcout << L"]";
+        output.put(L']');
+    }
+}
+
+// Same layout as printArray gives the equivalent flat Array
+void Interpreter::printArray(const Text& text) {
+    output.put(L'[');
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (i > 0) output.put(L' ');
+        if (text.characters()) {
+            output.put(text[i][0]);
+        }
+        else {
+            output.put(L'"');
+            output.put(text[i]);
+            output.put(L'"');
+        }
+    }
+    output.put(L']');
+}
+
+void Interpreter::printValue(const Value& value) {
+    if (value.scalar()) {
+        output.put(L'[');
+        output.put(value.number());
+        output.put(L']');
+    }
+    else if (value.holds<NDArray>()) {
+        printArray(value.get<NDArray>());
+    }
+    else if (value.holds<Text>()) {
+        printArray(value.get<Text>());
+    }
+    else {
+        printArray(value.get<Array>());
     }
 }
 
@@ -191,332 +360,971 @@ void Interpreter::getShape(const Array& arr, std::vector<size_t>& shape) {
     }
 }
 
-bool Interpreter::shapesEqual(const std::vector<size_t>& shape1, const std::vector<size_t>& shape2) {
-    return shape1 == shape2;
-}
-
-void Interpreter::applyBinaryOp(Stack& s, const String& opName, std::function<double(double, double)> op) {
-    if (s.size() < 2) {
-        std::wcerr << L"Error: Insufficient stack elements for " << opName << std::endl;
-        return;
+// Converts a rectangular Array whose leaves are all numbers into a dense NDArray.
+// Returns false (leaving `out` untouched) for ragged, empty or non-numeric data.
+bool Interpreter::toDense(const Array& arr, NDArray& out) {
+    std::vector<size_t> shape;
+    const Array* level = &arr;
+    while (true) {
+        if (level->empty()) return false;
+        shape.push_back(level->size());
+        const Element& first = (*level)[0];
+        if (std::holds_alternative<Array>(first)) {
+            level = &std::get<Array>(first);
+        }
+        else if (std::holds_alternative<double>(first)) {
+            break;
+        }
+        else {
+            return false;
+        }
     }
-    Array b = s.top(); s.pop();
-    Array a = s.top(); s.pop();
-    Array result;
-
-    bool aIsScalar = (a.size() == 1 && !std::holds_alternative<Array>(a[0]) && std::holds_alternative<double>(a[0]));
-    bool bIsScalar = (b.size() == 1 && !std::holds_alternative<Array>(b[0]) && std::holds_alternative<double>(b[0]));
 
-    std::vector<size_t> shapeA, shapeB;
-    getShape(a, shapeA);
-    getShape(b, shapeB);
-
-    std::function<Array(const Array&, const Array&, const std::vector<size_t>&)> applyOpRecursive =
-        [&](const Array& x, const Array& y, const std::vector<size_t>& shape) -> Array {
-        Array res;
-        if (shape.size() == 1) {
-            for (size_t i = 0; i < shape[0]; ++i) {
-                Element xElem = x.size() == 1 ? x[0] : x[i];
-                Element yElem = y.size() == 1 ? y[0] : y[i];
-                if (!std::holds_alternative<double>(xElem) || !std::holds_alternative<double>(yElem)) {
-                    std::wcerr << L"Error: " << opName << L" requires numeric arguments" << std::endl;
-                    return Array();
-                }
-                double yVal = std::get<double>(yElem);
-                if (opName == L"/" && yVal == 0.0) {
-                    std::wcerr << L"Error: Division by zero" << std::endl;
-                    return Array();
-                }
-                res.push_back(op(std::get<double>(xElem), yVal));
+    NDArray result(shape);
+    size_t pos = 0;
+    std::function<bool(const Array&, size_t)> fill = [&](const Array& current, size_t axis) -> bool {
+        if (current.size() != shape[axis]) return false;
+        if (axis + 1 == shape.size()) {
+            for (const auto& elem : current) {
+                if (!std::holds_alternative<double>(elem)) return false;
+                result.data[pos++] = std::get<double>(elem);
             }
+            return true;
         }
-        else {
-            size_t size = shape[0];
-            std::vector<size_t> subShape(shape.begin() + 1, shape.end());
-            for (size_t i = 0; i < size; ++i) {
-                Array xSub = x.size() == 1 && std::holds_alternative<Array>(x[0]) ? std::get<Array>(x[0]) : std::get<Array>(x[i]);
-                Array ySub = y.size() == 1 && std::holds_alternative<Array>(y[0]) ? std::get<Array>(y[0]) : std::get<Array>(y[i]);
-                Array subRes = applyOpRecursive(xSub, ySub, subShape);
-                if (subRes.empty()) {
-                    return Array();
-                }
-                res.push_back(subRes);
-            }
+        for (const auto& elem : current) {
+            if (!std::holds_alternative<Array>(elem) || !fill(std::get<Array>(elem), axis + 1)) return false;
         }
-        return res;
+        return true;
     };
+    if (!fill(arr, 0)) return false;
 
-    if (aIsScalar && !bIsScalar) {
-        result = applyOpRecursive(a, b, shapeB);
-    }
-    else if (bIsScalar && !aIsScalar) {
-        result = applyOpRecursive(a, b, shapeA);
-    }
-    else if (shapesEqual(shapeA, shapeB)) {
-        result = applyOpRecursive(a, b, shapeA);
-    }
-    else {
-        std::wcerr << L"Error: " << opName << L" requires a scalar or arrays of equal shape" << std::endl;
-        return;
+    out = std::move(result);
+    return true;
+}
+
+// Switches a value to its dense form when possible; returns true if it is
+// dense afterwards. Strided views are replaced by a compact copy unless
+// `views` says the caller walks strides itself.
+bool Interpreter::makeDense(Value& value, bool views) {
+    if (value.holds<NDArray>()) {
+        if (!views && !value.get<NDArray>().contiguous()) value = compact(value.get<NDArray>());
+        return true;
     }
+    if (!value.holds<Array>()) return false;
+    NDArray dense;
+    if (!toDense(value.get<Array>(), dense)) return false;
+    value = std::move(dense);
+    return true;
+}
 
-    if (result.empty()) {
-        return;
+// Switches an Array of nothing but characters, or nothing but strings, to
+// packed Text; returns true if it is Text afterwards
+bool Interpreter::makeText(Value& value) {
+    if (value.holds<Text>()) return true;
+    if (!value.holds<Array>() || value.get<Array>().empty()) return false;
+    const Array& arr = value.get<Array>();
+    bool characters = std::holds_alternative<wchar_t>(arr[0]);
+    Text text(characters);
+    for (const Element& elem : arr) {
+        if (const wchar_t* c = std::get_if<wchar_t>(&elem); c && characters) {
+            text.push(*c);
+        }
+        else if (const String* str = std::get_if<String>(&elem); str && !characters) {
+            text.push(std::wstring_view(*str));
+        }
+        else {
+            return false;
+        }
     }
-    s.push(result);
+    value = std::move(text);
+    return true;
 }
 
-void Interpreter::initBuiltIns() {
-    builtIns[L"+"] = [this](Stack& s) {
-        applyBinaryOp(s, L"+", [](double x, double y) { return x + y; });
-    };
+Array Interpreter::toNested(const Text& text) {
+    Array result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text.characters()) {
+            result.push_back(text[i][0]);
+        }
+        else {
+            result.push_back(String(text[i]));
+        }
+    }
+    return result;
+}
 
-    builtIns[L"-"] = [this](Stack& s) {
-        applyBinaryOp(s, L"-", [](double x, double y) { return x - y; });
+Array Interpreter::toNested(const NDArray& arr) {
+    std::function<Array(size_t, size_t)> build = [&](size_t axis, size_t offset) -> Array {
+        Array result;
+        result.reserve(arr.shape[axis]);
+        for (size_t i = 0; i < arr.shape[axis]; ++i) {
+            size_t pos = offset + i * arr.strides[axis];
+            if (axis + 1 == arr.rank()) {
+                result.push_back(arr.data[pos]);
+            }
+            else {
+                result.push_back(build(axis + 1, pos));
+            }
+        }
+        return result;
     };
+    if (arr.rank() == 0) return Array();
+    return build(0, 0);
+}
 
-    builtIns[L"*"] = [this](Stack& s) {
-        applyBinaryOp(s, L"*", [](double x, double y) { return x * y; });
-    };
+Array Interpreter::toNested(const Value& value) {
+    if (value.holds<NDArray>()) {
+        return toNested(value.get<NDArray>());
+    }
+    if (value.holds<Text>()) {
+        return toNested(value.get<Text>());
+    }
+    return value.get<Array>();
+}
 
-    builtIns[L"/"] = [this](Stack& s) {
-        applyBinaryOp(s, L"/", [](double x, double y) { return x / y; });
-    };
+// Like toNested, but moves the Array out instead of copying when `value` holds
+// the only reference to it
+Array Interpreter::takeNested(Value& value) {
+    if (value.holds<NDArray>()) {
+        return toNested(value.get<NDArray>());
+    }
+    if (value.holds<Text>()) {
+        return toNested(value.get<Text>());
+    }
+    return std::move(value.mutate<Array>());
+}
 
-    builtIns[L"^"] = [this](Stack& s) {
-        applyBinaryOp(s, L"^", [](double x, double y) { return std::pow(x, y); });
-    };
+bool Interpreter::shapesEqual(const std::vector<size_t>& shape1, const std::vector<size_t>& shape2) {
+    return shape1 == shape2;
+}
 
-    builtIns[L"cat"] = [this](Stack& s) {
-        if (s.size() < 2) {
-            std::wcerr << L"Error: Insufficient stack elements for cat" << std::endl;
-            return;
+bool Interpreter::hasZero(const NDArray& arr) {
+    if (arr.contiguous()) {
+        return std::find(arr.data.begin(), arr.data.end(), 0.0) != arr.data.end();
+    }
+    std::function<bool(size_t, size_t)> scan = [&](size_t axis, size_t offset) {
+        for (size_t i = 0; i < arr.shape[axis]; ++i) {
+            size_t pos = offset + i * arr.strides[axis];
+            if (axis + 1 == arr.rank() ? arr.data[pos] == 0.0 : scan(axis + 1, pos)) return true;
         }
-        Array b = s.top(); s.pop();
-        Array a = s.top(); s.pop();
-        Array result = a;
-        result.insert(result.end(), b.begin(), b.end());
-        s.push(result);
+        return false;
     };
+    return arr.size() > 0 && scan(0, 0);
+}
 
-    builtIns[L"."] = [this](Stack& s) {
-        if (s.empty()) {
-            std::wcerr << L"Error: Stack empty for ." << std::endl;
-            return;
+// Elementwise op over nested Arrays that did not convert to dense form. Walks
+// both operands by reference; a one-element side is broadcast at every level.
+template <typename Op>
+bool Interpreter::applyNested(const Array& x, const Array& y, const std::vector<size_t>& shape, size_t axis,
+    std::wstring_view opName, Array& res) {
+    Op op;
+    res.reserve(shape[axis]);
+    if (axis + 1 == shape.size()) {
+        for (size_t i = 0; i < shape[axis]; ++i) {
+            const Element& xElem = x.size() == 1 ? x[0] : x[i];
+            const Element& yElem = y.size() == 1 ? y[0] : y[i];
+            if (!std::holds_alternative<double>(xElem) || !std::holds_alternative<double>(yElem)) {
+                errors << L"Error: " << opName << L" requires numeric arguments" << std::endl;
+                return false;
+            }
+            double yVal = std::get<double>(yElem);
+            if (Op::checkZeroDivisor && yVal == 0.0) {
+                errors << L"Error: Division by zero" << std::endl;
+                return false;
+            }
+            res.push_back(op(std::get<double>(xElem), yVal));
         }
-        Array top = s.top(); s.pop();
-        printArray(top);
-        std::wcout << std::endl;
-    };
+        return true;
+    }
 
-    builtIns[L"clear"] = [this](Stack& s) {
-        while (!s.empty()) {
-            s.pop();
+    for (size_t i = 0; i < shape[axis]; ++i) {
+        const Element& xElem = x.size() == 1 ? x[0] : x[i];
+        const Element& yElem = y.size() == 1 ? y[0] : y[i];
+        // A scalar operand stays a scalar all the way down
+        const Array* xSub = x.size() == 1 && !std::holds_alternative<Array>(xElem) ? &x : std::get_if<Array>(&xElem);
+        const Array* ySub = y.size() == 1 && !std::holds_alternative<Array>(yElem) ? &y : std::get_if<Array>(&yElem);
+        if (!xSub || !ySub) {
+            errors << L"Error: " << opName << L" requires numeric arguments" << std::endl;
+            return false;
         }
-    };
-
-    builtIns[L"swap"] = [this](Stack& s) {
-        if (s.size() < 2) {
-            std::wcerr << L"Error: Insufficient stack elements for swap" << std::endl;
-            return;
+        Array subRes;
+        if (!applyNested<Op>(*xSub, *ySub, shape, axis + 1, opName, subRes) || subRes.empty()) {
+            return false;
         }
-        Array top = s.top(); s.pop();
-        Array second = s.top(); s.pop();
-        s.push(top);
-        s.push(second);
-    };
+        res.push_back(std::move(subRes));
+    }
+    return true;
+}
 
-    builtIns[L"dup"] = [this](Stack& s) {
-        if (s.empty()) {
-            std::wcerr << L"Error: Stack empty for dup" << std::endl;
+template <typename Op>
+void Interpreter::applyBinaryOp(Stack& s, std::wstring_view opName) {
+    if (s.size() < 2) {
+        errors << L"Error: Insufficient stack elements for " << opName << std::endl;
+        return;
+    }
+    // Two inline numbers need no shapes or buffers
+    if (s.top().scalar() && s[s.size() - 2].scalar()) {
+        double b = s.take().number();
+        if (Op::checkZeroDivisor && b == 0) {
+            s.pop();
+            errors << L"Error: Division by zero" << std::endl;
             return;
         }
-        Array top = s.top();
-        s.push(top);
-    };
+        s.top() = Op()(s.top().number(), b);
+        return;
+    }
 
-    builtIns[L"range"] = [this](Stack& s) {
-        if (s.empty()) {
-            std::wcerr << L"Error: Stack empty for range" << std::endl;
-            return;
-        }
-        Array top = s.top(); s.pop();
-        if (top.size() != 1 || !std::holds_alternative<double>(top[0])) {
-            std::wcerr << L"Error: range requires a scalar numeric argument" << std::endl;
-            return;
-        }
-        double val = std::get<double>(top[0]);
-        if (val < 0 || std::floor(val) != val) {
-            std::wcerr << L"Error: range requires a non-negative integer" << std::endl;
-            return;
-        }
-        Array result;
-        for (int i = 0; i < static_cast<int>(val); ++i) {
-            result.push_back(static_cast<double>(i));
-        }
-        s.push(result);
-    };
+    Value bv = s.take();
+    Value av = s.take();
 
-    builtIns[L"reshape"] = [this](Stack& s) {
-        if (s.size() < 2) {
-            std::wcerr << L"Error: Insufficient stack elements for reshape" << std::endl;
+    if (makeDense(av, true) && makeDense(bv, true)) {
+        if (lazyMode && canFuse(av, bv)) {
+            if (Op::checkZeroDivisor && hasZero(bv.get<NDArray>())) {
+                errors << L"Error: Division by zero" << std::endl;
+                return;
+            }
+            s.push(fuseBinary(binaryKernelFor<Op>(), std::move(av), std::move(bv)));
             return;
         }
-        Array shape = s.top(); s.pop();
-        Array data = s.top(); s.pop();
 
-        if (shape.empty()) {
-            std::wcerr << L"Error: reshape requires a non-empty shape array" << std::endl;
+        const NDArray& a = av.get<NDArray>();
+        const NDArray& b = bv.get<NDArray>();
+        std::vector<size_t> shape;
+        if (!broadcastShape(a.shape, b.shape, shape)) {
+            errors << L"Error: " << opName << L" requires arrays with broadcast-compatible shapes" << std::endl;
             return;
         }
-        std::vector<size_t> dims;
-        size_t total_size = 1;
-        for (const auto& elem : shape) {
-            if (!std::holds_alternative<double>(elem)) {
-                std::wcerr << L"Error: reshape shape must contain numeric values" << std::endl;
-                return;
-            }
-            double val = std::get<double>(elem);
-            if (val <= 0 || std::floor(val) != val) {
-                std::wcerr << L"Error: reshape dimensions must be positive integers" << std::endl;
-                return;
-            }
-            size_t dim = static_cast<size_t>(val);
-            dims.push_back(dim);
-            total_size *= dim;
-        }
 
-        if (data.size() != total_size) {
-            std::wcerr << L"Error: Data size does not match shape dimensions" << std::endl;
+        if (Op::checkZeroDivisor && hasZero(b)) {
+            errors << L"Error: Division by zero" << std::endl;
             return;
         }
 
-        std::function<Array(size_t, const std::vector<size_t>&, size_t&)> buildArray =
-            [&](size_t dimIdx, const std::vector<size_t>& dims, size_t& dataIdx) -> Array {
-            Array result;
-            if (dimIdx == dims.size() - 1) {
-                for (size_t i = 0; i < dims[dimIdx]; ++i) {
-                    if (dataIdx < data.size()) {
-                        result.push_back(data[dataIdx++]);
-                    }
-                }
-            }
-            else {
-                for (size_t i = 0; i < dims[dimIdx]; ++i) {
-                    result.push_back(buildArray(dimIdx + 1, dims, dataIdx));
-                }
-            }
-            return result;
-        };
+        // Write into an operand's buffer when this call holds its only reference.
+        // Moving the handle keeps the payload (and so `a` and `b`) in place.
+        Value out = av.unique() && a.shape == shape ? std::move(av)
+            : bv.unique() && b.shape == shape ? std::move(bv)
+            : Value(NDArray(shape));
+        NDArray& result = out.mutate<NDArray>();
+        broadcastApply(binaryKernelFor<Op>(), a, b, result);
+        s.push(std::move(out));
+        return;
+    }
 
-        size_t dataIdx = 0;
-        Array result = buildArray(0, dims, dataIdx);
-        s.push(result);
-    };
+    Array a = takeNested(av);
+    Array b = takeNested(bv);
 
-    builtIns[L"dim"] = [this](Stack& s) {
-        if (s.empty()) {
-            std::wcerr << L"Error: Stack empty for dim" << std::endl;
-            return;
-        }
-        Array arr = s.top(); s.pop();
-        Array result;
+    bool aIsScalar = (a.size() == 1 && std::holds_alternative<double>(a[0]));
+    bool bIsScalar = (b.size() == 1 && std::holds_alternative<double>(b[0]));
 
-        if (arr.size() == 1 && !std::holds_alternative<Array>(arr[0])) {
-            s.push(result);
-            return;
-        }
+    std::vector<size_t> shapeA, shapeB;
+    getShape(a, shapeA);
+    getShape(b, shapeB);
 
-        std::function<void(const Array&, std::vector<size_t>&)> getDims =
-            [&](const Array& current, std::vector<size_t>& dims) {
-            if (current.empty()) {
-                dims.push_back(0);
-                return;
-            }
-            dims.push_back(current.size());
-            bool hasArrays = false;
-            size_t subSize = 0;
-            for (size_t i = 0; i < current.size(); ++i) {
-                if (std::holds_alternative<Array>(current[i])) {
-                    Array subArr = std::get<Array>(current[i]);
-                    if (i == 0) {
-                        subSize = subArr.size();
-                        hasArrays = true;
-                    }
-                    else if (subArr.size() != subSize) {
-                        std::wcerr << L"Error: Non-uniform array for dim" << std::endl;
-                        s.push(result);
-                        return;
-                    }
-                }
-                else if (i == 0) {
-                    return;
-                }
-                else {
-                    std::wcerr << L"Error: Non-uniform array for dim" << std::endl;
-                    s.push(result);
-                    return;
-                }
-            }
-            if (hasArrays) {
-                getDims(std::get<Array>(current[0]), dims);
-            }
-        };
+    const std::vector<size_t>* shape;
+    if (aIsScalar && !bIsScalar) {
+        shape = &shapeB;
+    }
+    else if ((bIsScalar && !aIsScalar) || shapesEqual(shapeA, shapeB)) {
+        shape = &shapeA;
+    }
+    else {
+        errors << L"Error: " << opName << L" requires a scalar or arrays of equal shape" << std::endl;
+        return;
+    }
 
-        std::vector<size_t> dims;
+    Array result;
+    if (!applyNested<Op>(a, b, *shape, 0, opName, result) || result.empty()) {
+        return;
+    }
+    s.push(std::move(result));
+}
+
+template <typename Op>
+void Interpreter::applyUnaryOp(Stack& s, std::wstring_view opName) {
+    if (s.empty()) {
+        errors << L"Error: Stack empty for " << opName << std::endl;
+        return;
+    }
+    if (s.top().scalar()) {
+        s.top() = Op()(s.top().number());
+        return;
+    }
+    Value value = s.take();
+    if (!makeDense(value)) {
+        errors << L"Error: " << opName << L" requires numeric arguments" << std::endl;
+        return;
+    }
+    if (lazyMode && canFuse(value)) {
+        s.push(fuseUnary(unaryKernelFor<Op>(), std::move(value)));
+        return;
+    }
+    const NDArray& in = value.get<NDArray>();
+    Value out = value.unique() ? std::move(value) : Value(NDArray(in.shape));
+    NDArray& result = out.mutate<NDArray>();
+    unaryKernelFor<Op>()(in.data.data(), result.data.data(), result.size());
+    s.push(std::move(out));
+}
+
+// Reduces along the last axis, APL style: a vector gives a scalar, a matrix
+// one value per row
+template <typename Op>
+void Interpreter::applyReduction(Stack& s, std::wstring_view opName) {
+    if (s.empty()) {
+        errors << L"Error: Stack empty for " << opName << std::endl;
+        return;
+    }
+    Value value = s.take();
+    if (!makeDense(value)) {
+        errors << L"Error: " << opName << L" requires numeric arguments" << std::endl;
+        return;
+    }
+    const NDArray& in = value.get<NDArray>();
+    size_t cols = in.shape.back();
+    std::vector<size_t> shape(in.shape.begin(), in.shape.end() - 1);
+    if (shape.empty()) shape.push_back(1);
+    NDArray result(shape);
+    reduceRows<Op>(in.data.data(), in.size() / cols, cols, result.data.data(), pool);
+    s.push(std::move(result));
+}
+
+// Running reduction along the last axis; the result keeps the input's shape
+template <typename Op>
+void Interpreter::applyScan(Stack& s, std::wstring_view opName) {
+    if (s.empty()) {
+        errors << L"Error: Stack empty for " << opName << std::endl;
+        return;
+    }
+    Value value = s.take();
+    if (!makeDense(value)) {
+        errors << L"Error: " << opName << L" requires numeric arguments" << std::endl;
+        return;
+    }
+    const NDArray& in = value.get<NDArray>();
+    Value out = value.unique() ? std::move(value) : Value(NDArray(in.shape));
+    NDArray& result = out.mutate<NDArray>();
+    size_t cols = in.shape.back();
+    scanRows<Op>(in.data.data(), in.size() / cols, cols, result.data.data(), pool);
+    s.push(std::move(out));
+}
+
+// Pops a file name. A string literal and a bare word both arrive as Text
+// holding one string.
+bool Interpreter::popPath(Stack& s, std::wstring_view opName, std::filesystem::path& path) {
+    Value value = s.take();
+    if (value.holds<Text>()) {
+        const Text& text = value.get<Text>();
+        if (text.size() == 1 && !text.characters()) {
+            path = String(text[0]);
+            return true;
+        }
+    }
+    errors << L"Error: " << opName << L" requires a file name" << std::endl;
+    return false;
+}
+
+// Pops an integer operand such as a count or an index
+bool Interpreter::popInteger(Stack& s, std::wstring_view opName, long long& n) {
+    Value value = s.take();
+    if (!makeDense(value) || value.get<NDArray>().rank() != 1 || value.get<NDArray>().size() != 1) {
+        errors << L"Error: " << opName << L" requires an integer argument" << std::endl;
+        return false;
+    }
+    double number = value.get<NDArray>().data[0];
+    if (std::floor(number) != number || std::fabs(number) > 1e18) {
+        errors << L"Error: " << opName << L" requires an integer argument" << std::endl;
+        return false;
+    }
+    n = static_cast<long long>(number);
+    return true;
+}
+
+// Length of the leading axis; a single number counts as one item
+size_t Interpreter::itemCount(Value& value) {
+    if (makeDense(value, true)) return value.get<NDArray>().shape[0];
+    if (value.holds<Text>()) return value.get<Text>().size();
+    return value.get<Array>().size();
+}
+
+// Items [first, first + count) along the leading axis: a view of a dense
+// array, or a new array holding those elements of any other kind
+Value Interpreter::items(Value value, size_t first, size_t count) {
+    if (count == 0) return Array();
+    if (makeDense(value, true)) {
+        return sliceAxis(value.get<NDArray>(), 0, first, count);
+    }
+    Array all = takeNested(value);
+    Array selected;
+    selected.insert(selected.end(), std::make_move_iterator(all.begin() + first),
+        std::make_move_iterator(all.begin() + first + count));
+    Value part = std::move(selected);
+    if (!makeDense(part)) makeText(part);
+    return part;
+}
+
+// Item `index` along the leading axis, which must exist
+Value Interpreter::itemAt(Value value, size_t index) {
+    if (makeDense(value, true)) {
+        return item(value.get<NDArray>(), index);
+    }
+    Element elem = std::move(takeNested(value)[index]);
+    if (const double* number = std::get_if<double>(&elem)) {
+        return *number;
+    }
+    Array arr;
+    if (Array* nested = std::get_if<Array>(&elem)) {
+        arr = std::move(*nested);
+    }
+    else {
+        arr.push_back(std::move(elem));
+    }
+    Value result = std::move(arr);
+    if (!makeDense(result)) makeText(result);
+    return result;
+}
+
+// `x n take` keeps the first n items of x, or the last -n; `x n drop` keeps
+// the rest. Counts past the end take or drop everything.
+void Interpreter::applyTake(Stack& s, std::wstring_view opName, bool drop) {
+    if (s.size() < 2) {
+        errors << L"Error: Insufficient stack elements for " << opName << std::endl;
+        return;
+    }
+    long long n;
+    if (!popInteger(s, opName, n)) {
+        s.pop();
+        return;
+    }
+    Value value = s.take();
+    size_t length = itemCount(value);
+    size_t k = std::min<size_t>(length, static_cast<size_t>(n < 0 ? -n : n));
+    size_t first, count;
+    if (drop) {
+        first = n < 0 ? 0 : k;
+        count = length - k;
+    }
+    else {
+        first = n < 0 ? length - k : 0;
+        count = k;
+    }
+    s.push(items(std::move(value), first, count));
+}
+
+void Interpreter::defineBuiltIn(const String& name, BuiltInFunc func) {
+    symbols.edit(symbols.intern(name)).builtin = static_cast<uint32_t>(builtinTable.size());
+    builtinTable.push_back(std::move(func));
+}
+
+void Interpreter::initBuiltIns() {
+    defineBuiltIn(L"+", [this](Stack& s) {
+        applyBinaryOp<AddOp>(s, L"+");
+    });
+
+    defineBuiltIn(L"-", [this](Stack& s) {
+        applyBinaryOp<SubOp>(s, L"-");
+    });
+
+    defineBuiltIn(L"*", [this](Stack& s) {
+        applyBinaryOp<MulOp>(s, L"*");
+    });
+
+    defineBuiltIn(L"/", [this](Stack& s) {
+        applyBinaryOp<DivOp>(s, L"/");
+    });
+
+    defineBuiltIn(L"^", [this](Stack& s) {
+        applyBinaryOp<PowOp>(s, L"^");
+    });
+
+    defineBuiltIn(L"sqrt", [this](Stack& s) {
+        applyUnaryOp<SqrtOp>(s, L"sqrt");
+    });
+
+    defineBuiltIn(L"exp", [this](Stack& s) {
+        applyUnaryOp<ExpOp>(s, L"exp");
+    });
+
+    defineBuiltIn(L"log", [this](Stack& s) {
+        applyUnaryOp<LogOp>(s, L"log");
+    });
+
+    defineBuiltIn(L"abs", [this](Stack& s) {
+        applyUnaryOp<AbsOp>(s, L"abs");
+    });
+
+    defineBuiltIn(L"sum", [this](Stack& s) {
+        applyReduction<AddOp>(s, L"sum");
+    });
+
+    defineBuiltIn(L"max", [this](Stack& s) {
+        applyReduction<MaxOp>(s, L"max");
+    });
+
+    defineBuiltIn(L"min", [this](Stack& s) {
+        applyReduction<MinOp>(s, L"min");
+    });
+
+    defineBuiltIn(L"scan", [this](Stack& s) {
+        applyScan<AddOp>(s, L"scan");
+    });
+
+    defineBuiltIn(L"save", [this](Stack& s) {
+        if (s.size() < 2) {
+            errors << L"Error: Insufficient stack elements for save" << std::endl;
+            return;
+        }
+        std::filesystem::path path;
+        if (!popPath(s, L"save", path)) return;
+        Value value = s.take();
+        if (!makeDense(value)) {
+            errors << L"Error: save requires a numeric array" << std::endl;
+            return;
+        }
+        String error;
+        if (!saveArray(path, value.get<NDArray>(), error)) {
+            errors << L"Error: " << error << std::endl;
+        }
+    });
+
+    defineBuiltIn(L"load", [this](Stack& s) {
+        if (s.empty()) {
+            errors << L"Error: Stack empty for load" << std::endl;
+            return;
+        }
+        std::filesystem::path path;
+        if (!popPath(s, L"load", path)) return;
+        NDArray arr;
+        String error;
+        if (!loadArray(path, arr, error)) {
+            errors << L"Error: " << error << std::endl;
+            return;
+        }
+        // Empty arrays are only ever nested
+        if (arr.size() == 0) {
+            s.push(Array());
+            return;
+        }
+        s.push(std::move(arr));
+    });
+
+    defineBuiltIn(L"cat", [this](Stack& s) {
+        if (s.size() < 2) {
+            errors << L"Error: Insufficient stack elements for cat" << std::endl;
+            return;
+        }
+        Value bv = s.take();
+        Value av = s.take();
+
+        if (makeDense(av) && makeDense(bv)) {
+            const NDArray& a = av.get<NDArray>();
+            const NDArray& b = bv.get<NDArray>();
+            if (a.rank() == b.rank() && std::equal(a.shape.begin() + 1, a.shape.end(), b.shape.begin() + 1)) {
+                std::vector<size_t> shape = a.shape;
+                shape[0] += b.shape[0];
+                // Appends in place when `a` is not shared; b's payload is left alone
+                NDArray& result = av.mutate<NDArray>();
+                result.data.append(b.data.begin(), b.data.end());
+                result.reshape(shape);
+                s.push(std::move(av));
+                return;
+            }
+        }
+        else if (av.holds<Text>() && bv.holds<Text>() &&
+            av.get<Text>().characters() == bv.get<Text>().characters()) {
+            // One copy of b's characters, in place when `a` is not shared
+            av.mutate<Text>().append(bv.get<Text>());
+            s.push(std::move(av));
+            return;
+        }
+
+        Array a = takeNested(av);
+        Array b = takeNested(bv);
+        a.insert(a.end(), std::make_move_iterator(b.begin()), std::make_move_iterator(b.end()));
+        Value result = std::move(a);
+        if (!makeDense(result)) makeText(result);
+        s.push(std::move(result));
+    });
+
+    defineBuiltIn(L".", [this](Stack& s) {
+        if (s.empty()) {
+            errors << L"Error: Stack empty for ." << std::endl;
+            return;
+        }
+        Value top = s.take();
+        printValue(top);
+        output.put(L'\n');
+        output.flush();
+    });
+
+    defineBuiltIn(L"clear", [this](Stack& s) {
+        s.clear();
+    });
+
+    defineBuiltIn(L"swap", [this](Stack& s) {
+        if (s.size() < 2) {
+            errors << L"Error: Insufficient stack elements for swap" << std::endl;
+            return;
+        }
+        std::swap(s[s.size() - 1], s[s.size() - 2]);
+    });
+
+    defineBuiltIn(L"dup", [this](Stack& s) {
+        if (s.empty()) {
+            errors << L"Error: Stack empty for dup" << std::endl;
+            return;
+        }
+        s.push(s.top());
+    });
+
+    defineBuiltIn(L"range", [this](Stack& s) {
+        if (s.empty()) {
+            errors << L"Error: Stack empty for range" << std::endl;
+            return;
+        }
+        Value top = s.take();
+        if (!makeDense(top) || top.get<NDArray>().rank() != 1 || top.get<NDArray>().size() != 1) {
+            errors << L"Error: range requires a scalar numeric argument" << std::endl;
+            return;
+        }
+        double val = top.get<NDArray>().data[0];
+        if (val < 0 || std::floor(val) != val) {
+            errors << L"Error: range requires a non-negative integer" << std::endl;
+            return;
+        }
+        if (val == 0) {
+            s.push(Array());
+            return;
+        }
+        NDArray result({static_cast<size_t>(val)});
+        for (size_t i = 0; i < result.size(); ++i) {
+            result.data[i] = static_cast<double>(i);
+        }
+        s.push(std::move(result));
+    });
+
+    defineBuiltIn(L"reshape", [this](Stack& s) {
+        if (s.size() < 2) {
+            errors << L"Error: Insufficient stack elements for reshape" << std::endl;
+            return;
+        }
+        Array shape = toNested(s.take());
+        Value dataValue = s.take();
+
+        if (shape.empty()) {
+            errors << L"Error: reshape requires a non-empty shape array" << std::endl;
+            return;
+        }
+        std::vector<size_t> dims;
+        size_t total_size = 1;
+        for (const auto& elem : shape) {
+            if (!std::holds_alternative<double>(elem)) {
+                errors << L"Error: reshape shape must contain numeric values" << std::endl;
+                return;
+            }
+            double val = std::get<double>(elem);
+            if (val <= 0 || std::floor(val) != val) {
+                errors << L"Error: reshape dimensions must be positive integers" << std::endl;
+                return;
+            }
+            size_t dim = static_cast<size_t>(val);
+            dims.push_back(dim);
+            total_size *= dim;
+        }
+
+        // Top-level items are the atoms being rearranged, so a dense array keeps
+        // its trailing axes and only the leading one is replaced by `dims`.
+        // Only the shape is new; the elements stay shared with other copies.
+        if (makeDense(dataValue)) {
+            if (dataValue.get<NDArray>().shape[0] != total_size) {
+                errors << L"Error: Data size does not match shape dimensions" << std::endl;
+                return;
+            }
+            NDArray& arr = dataValue.mutate<NDArray>();
+            dims.insert(dims.end(), arr.shape.begin() + 1, arr.shape.end());
+            arr.reshape(dims);
+            s.push(std::move(dataValue));
+            return;
+        }
+
+        Array data = takeNested(dataValue);
+        if (data.size() != total_size) {
+            errors << L"Error: Data size does not match shape dimensions" << std::endl;
+            return;
+        }
+
+        std::function<Array(size_t, const std::vector<size_t>&, size_t&)> buildArray =
+            [&](size_t dimIdx, const std::vector<size_t>& dims, size_t& dataIdx) -> Array {
+            Array result;
+            if (dimIdx == dims.size() - 1) {
+                for (size_t i = 0; i < dims[dimIdx]; ++i) {
+                    if (dataIdx < data.size()) {
+                        result.push_back(std::move(data[dataIdx++]));
+                    }
+                }
+            }
+            else {
+                for (size_t i = 0; i < dims[dimIdx]; ++i) {
+                    result.push_back(buildArray(dimIdx + 1, dims, dataIdx));
+                }
+            }
+            return result;
+        };
+
+        size_t dataIdx = 0;
+        Value result = buildArray(0, dims, dataIdx);
+        makeText(result);
+        s.push(std::move(result));
+    });
+
+    defineBuiltIn(L"dim", [this](Stack& s) {
+        if (s.empty()) {
+            errors << L"Error: Stack empty for dim" << std::endl;
+            return;
+        }
+        Value value = s.take();
+        Array result;
+
+        if (value.holds<NDArray>()) {
+            const NDArray& dense = value.get<NDArray>();
+            if (dense.rank() == 1 && dense.size() == 1) {
+                s.push(result);
+                return;
+            }
+            NDArray dims({dense.rank()});
+            std::copy(dense.shape.begin(), dense.shape.end(), dims.data.begin());
+            s.push(std::move(dims));
+            return;
+        }
+        if (value.holds<Text>()) {
+            size_t count = value.get<Text>().size();
+            s.push(count == 1 ? Value(result) : Value(static_cast<double>(count)));
+            return;
+        }
+
+        const Array& arr = value.get<Array>();
+        if (arr.size() == 1 && !std::holds_alternative<Array>(arr[0])) {
+            s.push(result);
+            return;
+        }
+
+        std::function<void(const Array&, std::vector<size_t>&)> getDims =
+            [&](const Array& current, std::vector<size_t>& dims) {
+            if (current.empty()) {
+                dims.push_back(0);
+                return;
+            }
+            dims.push_back(current.size());
+            bool hasArrays = false;
+            size_t subSize = 0;
+            for (size_t i = 0; i < current.size(); ++i) {
+                if (std::holds_alternative<Array>(current[i])) {
+                    const Array& subArr = std::get<Array>(current[i]);
+                    if (i == 0) {
+                        subSize = subArr.size();
+                        hasArrays = true;
+                    }
+                    else if (subArr.size() != subSize) {
+                        errors << L"Error: Non-uniform array for dim" << std::endl;
+                        s.push(result);
+                        return;
+                    }
+                }
+                else if (i == 0) {
+                    return;
+                }
+                else {
+                    errors << L"Error: Non-uniform array for dim" << std::endl;
+                    s.push(result);
+                    return;
+                }
+            }
+            if (hasArrays) {
+                getDims(std::get<Array>(current[0]), dims);
+            }
+        };
+
+        std::vector<size_t> dims;
         getDims(arr, dims);
         if (dims.empty() && !result.empty()) {
             return;
         }
-        for (size_t dim : dims) {
-            result.push_back(static_cast<double>(dim));
+        for (size_t dim : dims) {
+            result.push_back(static_cast<double>(dim));
+        }
+        Value out = result;
+        makeDense(out);
+        s.push(out);
+    });
+
+    defineBuiltIn(L"take", [this](Stack& s) {
+        applyTake(s, L"take", false);
+    });
+
+    defineBuiltIn(L"drop", [this](Stack& s) {
+        applyTake(s, L"drop", true);
+    });
+
+    // `x i at` is item i of x, counting from the end when negative; `x [i, j] at`
+    // indexes one axis after another
+    defineBuiltIn(L"at", [this](Stack& s) {
+        if (s.size() < 2) {
+            errors << L"Error: Insufficient stack elements for at" << std::endl;
+            return;
+        }
+        Value indexValue = s.take();
+        Value value = s.take();
+        if (!makeDense(indexValue) || indexValue.get<NDArray>().rank() != 1) {
+            errors << L"Error: at requires integer indices" << std::endl;
+            return;
+        }
+        const NDArray& indices = indexValue.get<NDArray>();
+        for (double index : indices.data) {
+            if (std::floor(index) != index) {
+                errors << L"Error: at requires integer indices" << std::endl;
+                return;
+            }
+            double length = static_cast<double>(itemCount(value));
+            if (index < -length || index >= length) {
+                errors << L"Error: at index out of range" << std::endl;
+                return;
+            }
+            value = itemAt(std::move(value), static_cast<size_t>(index < 0 ? index + length : index));
+        }
+        s.push(std::move(value));
+    });
+
+    // `x [start, stop] slice` or `x [start, stop, step] slice` selects items
+    // along the leading axis, Python style: negative positions count from the
+    // end and out-of-range ones are clamped. One row per axis, such as
+    // `[[0, 2], [1, 3]]`, slices several axes at once.
+    defineBuiltIn(L"slice", [this](Stack& s) {
+        if (s.size() < 2) {
+            errors << L"Error: Insufficient stack elements for slice" << std::endl;
+            return;
+        }
+        Value specValue = s.take();
+        Value value = s.take();
+        if (!makeDense(specValue) || specValue.get<NDArray>().rank() > 2 ||
+            (specValue.get<NDArray>().shape.back() != 2 && specValue.get<NDArray>().shape.back() != 3)) {
+            errors << L"Error: slice requires [start, stop] or [start, stop, step] for each axis" << std::endl;
+            return;
+        }
+        if (!makeDense(value, true)) {
+            errors << L"Error: slice requires a numeric array" << std::endl;
+            return;
+        }
+        const NDArray& spec = specValue.get<NDArray>();
+        size_t width = spec.shape.back();
+        size_t axes = spec.size() / width;
+        if (axes > value.get<NDArray>().rank()) {
+            errors << L"Error: slice has more axes than the array" << std::endl;
+            return;
+        }
+        NDArray result = value.get<NDArray>();
+        for (size_t axis = 0; axis < axes; ++axis) {
+            const double* bounds = spec.data.data() + axis * width;
+            double length = static_cast<double>(result.shape[axis]);
+            double start = bounds[0], stop = bounds[1], step = width == 3 ? bounds[2] : 1;
+            if (std::floor(start) != start || std::floor(stop) != stop || std::floor(step) != step) {
+                errors << L"Error: slice bounds must be integers" << std::endl;
+                return;
+            }
+            if (step < 1) {
+                errors << L"Error: slice step must be positive" << std::endl;
+                return;
+            }
+            start = std::clamp(start < 0 ? start + length : start, 0.0, length);
+            stop = std::clamp(stop < 0 ? stop + length : stop, 0.0, length);
+            if (stop <= start) {
+                s.push(Array());
+                return;
+            }
+            size_t count = static_cast<size_t>(std::ceil((stop - start) / step));
+            result = sliceAxis(result, axis, static_cast<size_t>(start), count, static_cast<size_t>(step));
+        }
+        s.push(std::move(result));
+    });
+
+    defineBuiltIn(L"transpose", [this](Stack& s) {
+        if (s.empty()) {
+            errors << L"Error: Stack empty for transpose" << std::endl;
+            return;
+        }
+        Value value = s.take();
+        if (!makeDense(value, true)) {
+            errors << L"Error: transpose requires a numeric array" << std::endl;
+            return;
         }
-        s.push(result);
-    };
+        s.push(transposed(value.get<NDArray>()));
+    });
 
-    builtIns[L"matmul"] = [this](Stack& s) {
+    defineBuiltIn(L"matmul", [this](Stack& s) {
         if (s.size() < 2) {
-            std::wcerr << L"Error: Insufficient stack elements for matmul" << std::endl;
+            errors << L"Error: Insufficient stack elements for matmul" << std::endl;
+            return;
+        }
+        Value bv = s.take();
+        Value av = s.take();
+
+        // gemm reads any strides, so transposed and sliced views go in as is
+        if (makeDense(av, true) && makeDense(bv, true)) {
+            const NDArray& a = av.get<NDArray>();
+            const NDArray& b = bv.get<NDArray>();
+            if (a.rank() != 2 || b.rank() != 2) {
+                errors << L"Error: matmul requires 2D arrays" << std::endl;
+                return;
+            }
+            size_t m = a.shape[0], n = a.shape[1], p = b.shape[1];
+            if (n != b.shape[0]) {
+                errors << L"Error: Incompatible dimensions for matmul" << std::endl;
+                return;
+            }
+            NDArray result({m, p});
+            gemm(m, p, n, {a.data.data(), a.strides[0], a.strides[1]}, {b.data.data(), b.strides[0], b.strides[1]},
+                 result.data.data(), pool);
+            s.push(std::move(result));
             return;
         }
-        Array b = s.top(); s.pop();
-        Array a = s.top(); s.pop();
+
+        Array a = takeNested(av);
+        Array b = takeNested(bv);
 
         std::vector<size_t> shapeA, shapeB;
         getShape(a, shapeA);
         getShape(b, shapeB);
         if (shapeA.size() != 2 || shapeB.size() != 2) {
-            std::wcerr << L"Error: matmul requires 2D arrays" << std::endl;
+            errors << L"Error: matmul requires 2D arrays" << std::endl;
             return;
         }
 
         size_t m = shapeA[0], n = shapeA[1];
         size_t n_b = shapeB[0], p = shapeB[1];
         if (n != n_b) {
-            std::wcerr << L"Error: Incompatible dimensions for matmul" << std::endl;
+            errors << L"Error: Incompatible dimensions for matmul" << std::endl;
             return;
         }
 
         for (const auto& row : a) {
             if (!std::holds_alternative<Array>(row)) {
-                std::wcerr << L"Error: matmul requires 2D numeric arrays" << std::endl;
+                errors << L"Error: matmul requires 2D numeric arrays" << std::endl;
                 return;
             }
             for (const auto& elem : std::get<Array>(row)) {
                 if (!std::holds_alternative<double>(elem)) {
-                    std::wcerr << L"Error: matmul requires numeric elements" << std::endl;
+                    errors << L"Error: matmul requires numeric elements" << std::endl;
                     return;
                 }
             }
         }
         for (const auto& row : b) {
             if (!std::holds_alternative<Array>(row)) {
-                std::wcerr << L"Error: matmul requires 2D numeric arrays" << std::endl;
+                errors << L"Error: matmul requires 2D numeric arrays" << std::endl;
                 return;
             }
             for (const auto& elem : std::get<Array>(row)) {
                 if (!std::holds_alternative<double>(elem)) {
-                    std::wcerr << L"Error: matmul requires numeric elements" << std::endl;
+                    errors << L"Error: matmul requires numeric elements" << std::endl;
                     return;
                 }
             }
@@ -537,54 +1345,268 @@ void Interpreter::initBuiltIns() {
             result.push_back(row);
         }
         s.push(result);
-    };
+    });
+
+    // `a b dot` is `a b * sum` without the array of products: a and b have
+    // the same shape, and the products are summed along the last axis
+    defineBuiltIn(L"dot", [this](Stack& s) {
+        if (s.size() < 2) {
+            errors << L"Error: Insufficient stack elements for dot" << std::endl;
+            return;
+        }
+        Value bv = s.take();
+        Value av = s.take();
+        if (!makeDense(av) || !makeDense(bv)) {
+            errors << L"Error: dot requires numeric arguments" << std::endl;
+            return;
+        }
+        const NDArray& a = av.get<NDArray>();
+        const NDArray& b = bv.get<NDArray>();
+        if (a.shape != b.shape) {
+            errors << L"Error: dot requires arrays of equal shape" << std::endl;
+            return;
+        }
+        size_t cols = a.shape.back();
+        std::vector<size_t> shape(a.shape.begin(), a.shape.end() - 1);
+        if (shape.empty()) shape.push_back(1);
+        NDArray result(shape);
+        dotRows(a.data.data(), b.data.data(), cols ? a.size() / cols : result.size(), cols, result.data.data(), pool);
+        s.push(std::move(result));
+    });
+
+    // `a b outer` multiplies every element of a by every element of b; the
+    // result's shape is a's followed by b's
+    defineBuiltIn(L"outer", [this](Stack& s) {
+        if (s.size() < 2) {
+            errors << L"Error: Insufficient stack elements for outer" << std::endl;
+            return;
+        }
+        Value bv = s.take();
+        Value av = s.take();
+        if (!makeDense(av) || !makeDense(bv)) {
+            errors << L"Error: outer requires numeric arguments" << std::endl;
+            return;
+        }
+        const NDArray& a = av.get<NDArray>();
+        const NDArray& b = bv.get<NDArray>();
+        std::vector<size_t> shape = a.shape;
+        shape.insert(shape.end(), b.shape.begin(), b.shape.end());
+        NDArray result(shape);
+        outer(a.size(), b.size(), a.data.data(), b.data.data(), result.data.data(), pool);
+        s.push(std::move(result));
+    });
+
+    // `a b c fma` is `a b * c +` in one pass, rounded once. Each operand is a
+    // single number or has the result's shape.
+    defineBuiltIn(L"fma", [this](Stack& s) {
+        if (s.size() < 3) {
+            errors << L"Error: Insufficient stack elements for fma" << std::endl;
+            return;
+        }
+        if (s.top().scalar() && s[s.size() - 2].scalar() && s[s.size() - 3].scalar()) {
+            double c = s.take().number();
+            double b = s.take().number();
+            s.top() = std::fma(s.top().number(), b, c);
+            return;
+        }
+        Value cv = s.take();
+        Value bv = s.take();
+        Value av = s.take();
+        Value* operands[] = {&av, &bv, &cv};
+        for (Value* operand : operands) {
+            if (!makeDense(*operand)) {
+                errors << L"Error: fma requires numeric arguments" << std::endl;
+                return;
+            }
+        }
+
+        // The result takes the shape of the operands that are not single
+        // numbers, or the highest rank's when all of them are
+        const NDArray* shaped = &av.get<NDArray>();
+        for (Value* operand : operands) {
+            const NDArray& arr = operand->get<NDArray>();
+            if (arr.size() != 1 && shaped->size() != 1 && arr.shape != shaped->shape) {
+                errors << L"Error: fma requires single numbers or arrays of equal shape" << std::endl;
+                return;
+            }
+            if (shaped->size() == 1 && (arr.size() != 1 || arr.rank() > shaped->rank())) shaped = &arr;
+        }
+        std::vector<size_t> shape = shaped->shape;
+
+        const double* data[3];
+        bool single[3];
+        Value* reuse = nullptr;
+        for (size_t i = 0; i < 3; ++i) {
+            const NDArray& arr = operands[i]->get<NDArray>();
+            data[i] = arr.data.data();
+            single[i] = arr.size() == 1;
+            if (!reuse && operands[i]->unique() && arr.shape == shape) reuse = operands[i];
+        }
+        // Moving the handle keeps the payload, and so data[], in place
+        Value out = reuse ? std::move(*reuse) : Value(NDArray(shape));
+        double* result = out.mutate<NDArray>().data.data();
+
+        constexpr size_t chunk = 16384;
+        size_t n = out.get<NDArray>().size();
+        FmaKernelFn kernel = simdKernels().fma;
+        pool.parallelFor((n + chunk - 1) / chunk, [&](size_t item) {
+            size_t begin = item * chunk;
+            auto at = [&](size_t i) { return data[i] + (single[i] ? 0 : begin); };
+            kernel(at(0), single[0], at(1), single[1], at(2), single[2], result + begin, std::min(chunk, n - begin));
+        });
+        s.push(std::move(out));
+    });
+}
+
+uint32_t Interpreter::addConstant(Code& code, Value value) {
+    code.constants.push_back(std::move(value));
+    return static_cast<uint32_t>(code.constants.size() - 1);
+}
+
+// Resolves a plain token once. Anything that could name a user word goes through
+// its symbol so words defined later still take precedence over builtins and literals.
+void Interpreter::compileToken(Code& code, std::wstring_view token) {
+    if (isFunctionName(token)) {
+        uint32_t id = symbols.intern(token);
+        if (symbols[id].builtin != Symbol::noBuiltin) {
+            code.instructions.push_back({OpCode::CallWordOrBuiltin, id, 0});
+        }
+        else {
+            code.instructions.push_back({OpCode::CallWordOrPush, id, addConstant(code, parseValue(token))});
+        }
+        return;
+    }
+    uint32_t id = symbols.find(token);
+    if (id != SymbolTable::none && symbols[id].builtin != Symbol::noBuiltin) {
+        code.instructions.push_back({OpCode::CallBuiltin, symbols[id].builtin, id});
+        return;
+    }
+    code.instructions.push_back({OpCode::PushConst, addConstant(code, parseValue(token)), 0});
 }
 
-void Interpreter::evaluate(const std::vector<String>& tokens, bool isFunctionBody) {
+// With `complete`, tokens may end partway through a definition or a directive
+// that needs one more token; that trailing statement is left uncompiled and
+// *complete is set to the index where it starts.
+Code Interpreter::compile(const TokenList& tokens, bool isFunctionBody, size_t* complete) {
+    Code code;
     bool defining = false;
-    String funcName;
-    std::vector<String> funcBody;
+    std::wstring_view funcName;
+    TokenList funcBody(&lineArena);
+    bool unfinished = false;
+    size_t statementStart = 0;
+    size_t statementCode = 0;
 
     for (size_t i = 0; i < tokens.size(); ++i) {
-        const String& token = tokens[i];
+        std::wstring_view token = tokens[i];
+        if (!defining) {
+            statementStart = i;
+            statementCode = code.instructions.size();
+        }
 
         if (token == L":dump") {
-            Stack temp;
-            std::wcout << L"Stack:" << std::endl;
-            if (stack.empty()) {
-                std::wcout << L"(empty)" << std::endl;
+            code.instructions.push_back({OpCode::DumpStack, 0, 0});
+            continue;
+        }
+
+        // `:lazy on|off` and `:summary on|off`; any other `:lazy` or
+        // `:summary` still starts a definition
+        if (!defining && (token == L":lazy" || token == L":summary") && i + 1 < tokens.size() &&
+            (tokens[i + 1] == L"on" || tokens[i + 1] == L"off")) {
+            OpCode op = token == L":lazy" ? OpCode::SetLazy : OpCode::SetSummary;
+            code.instructions.push_back({op, tokens[i + 1] == L"on", 0});
+            ++i;
+            continue;
+        }
+
+        // `:profile on|off|report`, and `:profile folded FILE`
+        if (!defining && token == L":profile" && i + 1 < tokens.size()) {
+            std::wstring_view command = tokens[i + 1];
+            if (command == L"folded") {
+                if (i + 2 < tokens.size()) {
+                    code.messages.emplace_back(tokens[i + 2]);
+                    code.instructions.push_back({OpCode::Profile, ProfileFolded,
+                        static_cast<uint32_t>(code.messages.size() - 1)});
+                    i += 2;
+                    continue;
+                }
+                if (complete) {
+                    unfinished = true;
+                    break;
+                }
             }
-            else {
-                while (!stack.empty()) {
-                    temp.push(stack.top());
-                    printArray(stack.top());
-                    std::wcout << std::endl;
-                    stack.pop();
+            else if (command == L"on" || command == L"off" || command == L"report") {
+                uint32_t arg = command == L"on" ? ProfileOn : command == L"off" ? ProfileOff : ProfileReport;
+                code.instructions.push_back({OpCode::Profile, arg, UINT32_MAX});
+                ++i;
+                continue;
+            }
+        }
+
+        // `:mem`, `:mem on|off|report` and `:mem json FILE`
+        if (!defining && token == L":mem") {
+            std::wstring_view command = i + 1 < tokens.size() ? tokens[i + 1] : std::wstring_view();
+            if (command == L"json") {
+                if (i + 2 < tokens.size()) {
+                    code.messages.emplace_back(tokens[i + 2]);
+                    code.instructions.push_back({OpCode::Memory, MemoryJson,
+                        static_cast<uint32_t>(code.messages.size() - 1)});
+                    i += 2;
+                    continue;
                 }
-                while (!temp.empty()) {
-                    stack.push(temp.top());
-                    temp.pop();
+                if (complete) {
+                    unfinished = true;
+                    break;
                 }
             }
-            continue;
+            else if (command.empty() && complete) {
+                // The next chunk may hold a subcommand
+                unfinished = true;
+                break;
+            }
+            else {
+                uint32_t arg = command == L"on" ? MemoryOn : command == L"off" ? MemoryOff : MemoryReport;
+                code.instructions.push_back({OpCode::Memory, arg, UINT32_MAX});
+                if (command == L"on" || command == L"off" || command == L"report") ++i;
+                continue;
+            }
+        }
+
+        // `:save-image FILE`
+        if (!defining && token == L":save-image") {
+            if (i + 1 < tokens.size()) {
+                code.messages.emplace_back(tokens[i + 1]);
+                code.instructions.push_back({OpCode::SaveImage, static_cast<uint32_t>(code.messages.size() - 1), 0});
+                ++i;
+                continue;
+            }
+            if (complete) {
+                unfinished = true;
+                break;
+            }
         }
 
         if (!isFunctionBody && !defining && token.size() > 1 && (token[0] == L':')) {
             funcName = token.substr(1);
 
+            if (complete && i + 1 == tokens.size()) {
+                unfinished = true;
+                break;
+            }
             if (i + 1 < tokens.size() && isFunctionName(funcName)) {
                 defining = true;
                 continue;
             }
             else {
-                std::wcerr << L"Error: Invalid function definition" << std::endl;
+                code.messages.push_back(L"Error: Invalid function definition");
+                code.instructions.push_back({OpCode::ReportError, static_cast<uint32_t>(code.messages.size() - 1), 0});
                 continue;
             }
         }
 
         if (defining) {
             if (token == L":end") {
-                functions[funcName] = funcBody;
+                code.bodies.push_back(std::make_shared<const Code>(compile(funcBody, true)));
+                code.instructions.push_back({OpCode::DefineWord, symbols.intern(funcName), static_cast<uint32_t>(code.bodies.size() - 1)});
                 defining = false;
                 funcBody.clear();
                 continue;
@@ -593,72 +1615,636 @@ void Interpreter::evaluate(const std::vector<String>& tokens, bool isFunctionBod
             continue;
         }
 
-        if (functions.find(token) != functions.end()) {
-            evaluate(functions[token], true);
-            continue;
+        compileToken(code, token);
+    }
+
+    if (complete) {
+        *complete = tokens.size();
+        if (unfinished || defining) {
+            // Drop what the unfinished statement emitted; it is compiled again
+            // once the rest of it arrives
+            code.instructions.resize(statementCode);
+            *complete = statementStart;
         }
+    }
+    return code;
+}
 
-        if (builtIns.find(token) != builtIns.end()) {
-            builtIns[token](stack);
-            continue;
+void Interpreter::dumpStack() {
+    output.put(L"Stack:\n");
+    if (stack.empty()) {
+        output.put(L"(empty)\n");
+    }
+    else {
+        for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+            printValue(*it);
+            output.put(L'\n');
         }
+    }
+    output.flush();
+}
 
-        stack.push(parseArray(token));
+// Binds a word, then relinks every word whose body baked in the old definition
+void Interpreter::defineWord(uint32_t id, std::shared_ptr<const Code> source) {
+    symbols.edit(id).source = std::move(source);
+    symbols.edit(id).body = std::make_shared<const Code>(link(*symbols[id].source, id));
+    for (uint32_t dependent : std::exchange(symbols.editDependents(id), {})) {
+        symbols.edit(dependent).body = std::make_shared<const Code>(link(*symbols[dependent].source, dependent));
     }
 }
 
-std::vector<String> Interpreter::tokenize(const String& input) {
-    std::vector<String> tokens;
-    String current;
-    bool inQuotes = false;
-    int bracketDepth = 0;
+// Error sink for foldConstants, which only needs to know whether the builtin
+// complained; far cheaper to set up than a string stream
+struct ErrorCatcher : std::wstreambuf {
+    bool written = false;
 
-    for (size_t i = 0; i < input.length(); ++i) {
-        wchar_t c = input[i];
+    int_type overflow(int_type c) override {
+        written = true;
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const wchar_t*, std::streamsize n) override {
+        written = true;
+        return n;
+    }
+};
 
-        if (c == L'"' && (i == 0 || input[i - 1] != L'\\')) {
-            inQuotes = !inQuotes;
-            current += c;
-            continue;
+// Number of elements in a constant, counting a nested array's top-level items
+static size_t elementCount(const Value& value) {
+    if (value.holds<NDArray>()) return value.get<NDArray>().size();
+    if (value.holds<Text>()) return value.get<Text>().size();
+    return value.get<Array>().size();
+}
+
+// A word is inlined when its definition is this short and only pushes and calls
+static bool inlinable(const Code& source) {
+    constexpr size_t maxInlineInstructions = 8;
+    if (source.instructions.size() > maxInlineInstructions) return false;
+    for (const Instruction& ins : source.instructions) {
+        if (ins.op != OpCode::PushConst && ins.op != OpCode::CallBuiltin &&
+            ins.op != OpCode::CallWordOrBuiltin && ins.op != OpCode::CallWordOrPush) {
+            return false;
         }
-        if (inQuotes) {
-            current += c;
-            continue;
+    }
+    return true;
+}
+
+// Builds the body word `self` runs from its definition. Calls to short words
+// are replaced by their definitions, expanded the same way, foldable
+// builtins applied to constants are computed now, and shuffles of constants
+// are resolved. The result depends only on
+// current definitions: every symbol expanded or folded records `self` as a
+// dependent, so redefining it relinks `self`. Words on a cycle with the one
+// being expanded are still called, keeping recursion intact.
+Code Interpreter::link(const Code& source, uint32_t self) {
+    if (reference) return source;
+    constexpr size_t maxInlineDepth = 4;
+    Code out;
+    out.messages = source.messages;
+    out.bodies = source.bodies;
+    std::vector<uint32_t> expanding{self};
+
+    auto reaches = [&](uint32_t from, uint32_t to) {
+        std::vector<uint32_t> pending{from};
+        std::vector<bool> seen(symbols.size());
+        while (!pending.empty()) {
+            uint32_t word = pending.back();
+            pending.pop_back();
+            if (word == to) return true;
+            if (seen[word] || !symbols[word].source) continue;
+            seen[word] = true;
+            for (const Instruction& ins : symbols[word].source->instructions) {
+                if (ins.op == OpCode::CallWordOrBuiltin || ins.op == OpCode::CallWordOrPush) {
+                    pending.push_back(ins.arg);
+                }
+            }
         }
-        if (c == L'[') {
-            bracketDepth++;
-            current += c;
-            continue;
+        return false;
+    };
+    auto expandable = [&](uint32_t word) {
+        const Code* definition = symbols[word].source.get();
+        if (!definition || expanding.size() > maxInlineDepth || !inlinable(*definition)) return false;
+        for (uint32_t outer : expanding) {
+            if (reaches(word, outer)) return false;
         }
-        if (c == L']') {
-            bracketDepth--;
-            current += c;
-            if (bracketDepth == 0 && !current.empty()) {
-                tokens.push_back(current);
-                current.clear();
+        return true;
+    };
+
+    std::function<void(const Code&, const Instruction&)> emit = [&](const Code& from, const Instruction& ins) {
+        if ((ins.op == OpCode::CallWordOrBuiltin || ins.op == OpCode::CallWordOrPush) && expandable(ins.arg)) {
+            addDependent(ins.arg, self);
+            const Code& definition = *symbols[ins.arg].source;
+            expanding.push_back(ins.arg);
+            for (const Instruction& inner : definition.instructions) {
+                emit(definition, inner);
             }
-            continue;
+            expanding.pop_back();
+            return;
+        }
+
+        Instruction copy = ins;
+        if (ins.op == OpCode::PushConst) {
+            copy.arg = addConstant(out, from.constants[ins.arg]);
+        }
+        else if (ins.op == OpCode::CallWordOrPush && symbols[ins.arg].source) {
+            copy.alt = addConstant(out, from.constants[ins.alt]);
+        }
+        else if (ins.op == OpCode::CallWordOrPush) {
+            // No word has the name yet, so for now it is a constant folding can use
+            copy = {OpCode::PushConst, addConstant(out, from.constants[ins.alt]), 0};
+            addDependent(ins.arg, self);
+        }
+        out.instructions.push_back(copy);
+
+        uint32_t symbol = ins.op == OpCode::CallBuiltin ? ins.alt : ins.arg;
+        if (ins.op == OpCode::CallBuiltin || (ins.op == OpCode::CallWordOrBuiltin && !symbols[symbol].source)) {
+            if (!foldConstants(out, symbol, self)) simplifyStack(out, symbol, self);
+        }
+    };
+
+    for (const Instruction& ins : source.instructions) {
+        emit(source, ins);
+    }
+    return out;
+}
+
+// If the builtin call that ends `code` has only constant operands, runs it now
+// and replaces the pushes and the call with its result. Operands it would
+// reject are left alone, so the error is still reported each time the word
+// runs, and so are calls whose operands or result are too big to keep as
+// constants.
+bool Interpreter::foldConstants(Code& code, uint32_t symbol, uint32_t self) {
+    // Bound on the elements of a folded builtin's operands and result
+    constexpr double maxFoldedElements = 65536;
+
+    uint32_t builtin = symbols[symbol].builtin;
+    const FoldRule& rule = foldRules[builtin];
+    size_t n = code.instructions.size();
+    if (rule.arity == 0 || n < rule.arity + 1u) return false;
+    for (size_t i = n - 1 - rule.arity; i < n - 1; ++i) {
+        if (code.instructions[i].op != OpCode::PushConst) return false;
+    }
+    Stack operands;
+    operands.reserve(rule.arity);
+    for (size_t i = n - 1 - rule.arity; i < n - 1; ++i) {
+        operands.push(code.constants[code.instructions[i].arg]);
+    }
+    // A big operand stays a run-time computation even when the result would
+    // be small, so defining a word never does a large builtin's work
+    for (const Value& operand : operands) {
+        if (!operand.scalar() && elementCount(operand) > maxFoldedElements) return false;
+    }
+    if (rule.growth != FoldGrowth::None) {
+        // Checked before running, so a huge result is never even built
+        double elements = 1;
+        std::vector<size_t> shape;
+        if (rule.growth == FoldGrowth::Count) {
+            // A one-element constant is always held as an inline number
+            if (!operands.top().scalar()) return false;
+            elements = operands.top().number();
+        }
+        else if (rule.growth == FoldGrowth::Broadcast && operands[0].holds<NDArray>() && operands[1].holds<NDArray>() &&
+            broadcastShape(operands[0].get<NDArray>().shape, operands[1].get<NDArray>().shape, shape)) {
+            for (size_t dim : shape) elements *= static_cast<double>(dim);
+        }
+        else {
+            for (const Value& operand : operands) elements *= static_cast<double>(elementCount(operand));
+        }
+        if (!(elements <= maxFoldedElements)) return false;
+    }
+
+    ErrorCatcher caught;
+    std::wstreambuf* console = errors.rdbuf(&caught);
+    bool lazy = std::exchange(lazyMode, false);
+    builtinTable[builtin](operands);
+    lazyMode = lazy;
+    errors.rdbuf(console);
+    if (caught.written || operands.size() != 1) return false;
+
+    code.instructions.resize(n - 1 - rule.arity);
+    code.instructions.push_back({OpCode::PushConst, addConstant(code, operands.take()), 0});
+    addDependent(symbol, self);
+    return true;
+}
+
+// Stack-effect rewrites for the shuffle builtin that ends `code`. The only
+// values known to be on the stack are the constants just pushed, so dup and
+// swap of constants become plain pushes, which later calls may fold further,
+// and constants pushed right before clear are dropped along with any clear
+// before them. A shuffle that could fail at run time is left in place so it
+// still reports the error.
+void Interpreter::simplifyStack(Code& code, uint32_t symbol, uint32_t self) {
+    Shuffle shuffle = foldRules[symbols[symbol].builtin].shuffle;
+    if (shuffle == Shuffle::None) return;
+    std::vector<Instruction>& ins = code.instructions;
+    size_t n = ins.size();
+    auto pushed = [&](size_t count) {
+        if (n < count + 1) return false;
+        for (size_t i = n - 1 - count; i < n - 1; ++i) {
+            if (ins[i].op != OpCode::PushConst) return false;
+        }
+        return true;
+    };
+    if (shuffle == Shuffle::Dup && pushed(1)) {
+        ins.back() = ins[n - 2];
+    }
+    else if (shuffle == Shuffle::Swap && pushed(2)) {
+        ins.pop_back();
+        std::swap(ins[n - 3], ins[n - 2]);
+    }
+    else if (shuffle == Shuffle::Clear) {
+        Instruction call = ins.back();
+        size_t keep = n - 1;
+        while (keep > 0 && (ins[keep - 1].op == OpCode::PushConst ||
+                            (ins[keep - 1].op == call.op && ins[keep - 1].arg == call.arg &&
+                             ins[keep - 1].alt == call.alt))) {
+            --keep;
         }
-        if (std::iswspace(c) && bracketDepth == 0 && !inQuotes) {
-            if (!current.empty()) {
-                tokens.push_back(current);
-                current.clear();
+        if (keep == n - 1) return;
+        ins.resize(keep);
+        ins.push_back(call);
+    }
+    else {
+        return;
+    }
+    addDependent(symbol, self);
+}
+
+void Interpreter::addDependent(uint32_t symbol, uint32_t dependent) {
+    std::vector<uint32_t>& dependents = symbols.editDependents(symbol);
+    if (std::find(dependents.begin(), dependents.end(), dependent) == dependents.end()) {
+        dependents.push_back(dependent);
+    }
+}
+
+// Runs code without recursing on the native stack. Calling a word saves the
+// caller's position on returnStack and carries on in the word's body; a call
+// that is the last instruction of a word reuses that word's frame instead, so
+// tail recursion runs in constant space and deep nesting only costs heap.
+void Interpreter::evaluate(const Code& code) {
+    const size_t base = returnStack.size();
+    const Code* current = &code;
+    size_t pc = 0;
+
+    auto callWord = [&](uint32_t symbol, const Code* body) {
+        if (pc == current->instructions.size() && returnStack.size() > base) {
+            if (profiling) profiler.leave();
+        }
+        else if (returnStack.size() - base >= maxCallDepth) {
+            // Abandon the whole chain and resume after the top-level call
+            errors << L"Error: Words nested more than " << maxCallDepth << L" calls deep" << std::endl;
+            Frame outermost = returnStack[base];
+            while (returnStack.size() > base) {
+                if (profiling) profiler.leave();
+                returnStack.pop_back();
             }
+            current = outermost.code;
+            pc = outermost.pc;
+            return;
+        }
+        else {
+            returnStack.push_back({current, pc});
+        }
+        if (profiling) profiler.enter(symbol);
+        current = body;
+        pc = 0;
+    };
+
+    while (true) {
+        if (pc == current->instructions.size()) {
+            if (returnStack.size() == base) return;
+            if (profiling) profiler.leave();
+            current = returnStack.back().code;
+            pc = returnStack.back().pc;
+            returnStack.pop_back();
             continue;
         }
-        current += c;
+
+        const Instruction& ins = current->instructions[pc++];
+        switch (ins.op) {
+        case OpCode::PushConst:
+            stack.push(current->constants[ins.arg]);
+            break;
+        case OpCode::CallBuiltin:
+            runBuiltin(ins.alt, ins.arg);
+            break;
+        case OpCode::CallWordOrBuiltin: {
+            const Symbol& symbol = symbols[ins.arg];
+            if (const Code* body = symbol.body.get()) {
+                callWord(ins.arg, body);
+            }
+            else {
+                runBuiltin(ins.arg, symbol.builtin);
+            }
+            break;
+        }
+        case OpCode::CallWordOrPush:
+            if (const Code* body = symbols[ins.arg].body.get()) {
+                callWord(ins.arg, body);
+            }
+            else {
+                stack.push(current->constants[ins.alt]);
+            }
+            break;
+        case OpCode::DefineWord:
+            defineWord(ins.arg, current->bodies[ins.alt]);
+            break;
+        case OpCode::DumpStack:
+            dumpStack();
+            break;
+        case OpCode::SetLazy:
+            lazyMode = ins.arg != 0;
+            break;
+        case OpCode::SetSummary:
+            summaryMode = ins.arg != 0;
+            break;
+        case OpCode::Profile:
+            profileCommand(ins.arg, ins.alt < current->messages.size() ? &current->messages[ins.alt] : nullptr);
+            break;
+        case OpCode::SaveImage:
+            saveImage(current->messages[ins.arg]);
+            break;
+        case OpCode::ReportError:
+            errors << current->messages[ins.arg] << std::endl;
+            break;
+        case OpCode::Memory:
+            memoryCommand(ins.arg, ins.alt < current->messages.size() ? &current->messages[ins.alt] : nullptr);
+            break;
+        }
+    }
+}
+
+// The profiler and memory meter hooks cost an untaken branch each per call
+// while they are off
+void Interpreter::runBuiltin(uint32_t symbol, uint32_t builtin) {
+    if (profiling) profiler.enter(symbol);
+    if (metering) meter.enter();
+    builtinTable[builtin](stack);
+    if (metering) meter.leave(symbol);
+    if (profiling) profiler.leave();
+}
+
+void Interpreter::profileCommand(uint32_t command, const String* path) {
+    switch (command) {
+    case ProfileOff:
+        profiling = false;
+        break;
+    case ProfileOn:
+        profiler.reset();
+        profiling = true;
+        break;
+    case ProfileReport:
+        profiler.report(output, symbols);
+        output.flush();
+        break;
+    case ProfileFolded: {
+        String error;
+        if (!profiler.writeFolded(std::filesystem::path(*path), symbols, error)) {
+            errors << L"Error: " << error << std::endl;
+        }
+        break;
+    }
+    }
+}
+
+void Interpreter::memoryCommand(uint32_t command, const String* path) {
+    switch (command) {
+    case MemoryOff:
+        metering = false;
+        arrayMemory = nullptr;
+        break;
+    case MemoryOn:
+        meterMemory();
+        arrayMemory = &meter.arrays;
+        break;
+    case MemoryReport:
+        meter.sample(stack, symbols);
+        meter.report(output, symbols);
+        output.flush();
+        break;
+    case MemoryJson:
+        writeMemory(std::filesystem::path(*path));
+        break;
     }
-    if (!current.empty()) {
-        tokens.push_back(current);
+}
+
+void Interpreter::meterMemory() {
+    meter.reset();
+    metering = true;
+}
+
+bool Interpreter::writeMemory(const std::filesystem::path& path) {
+    meter.sample(stack, symbols);
+    String error;
+    if (!meter.writeJson(path, symbols, error)) {
+        errors << L"Error: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Interpreter::saveImage(const String& path) {
+    Image image;
+    for (uint32_t id = 0; id < symbols.size(); ++id) {
+        if (symbols[id].source) image.words.emplace_back(id, symbols[id].source);
     }
+    image.stack = stack;
+    image.lazyMode = lazyMode;
+    image.summaryMode = summaryMode;
+    String error;
+    if (!::saveImage(std::filesystem::path(path), symbols, image, error)) {
+        errors << L"Error: " << error << std::endl;
+    }
+}
+
+// Only sources are stored; every body is linked again here, against this
+// build's builtins, once all the image's definitions are in place
+bool Interpreter::loadImage(const std::filesystem::path& path) {
+    Image image;
+    String error;
+    if (!::loadImage(path, symbols, image, error)) {
+        errors << L"Error: " << error << std::endl;
+        return false;
+    }
+    for (auto& [id, source] : image.words) {
+        symbols.edit(id).source = std::move(source);
+    }
+    symbols.clearDependents();
+    for (uint32_t id = 0; id < symbols.size(); ++id) {
+        if (symbols[id].source) symbols.edit(id).body = std::make_shared<const Code>(link(*symbols[id].source, id));
+    }
+    stack = std::move(image.stack);
+    lazyMode = image.lazyMode;
+    summaryMode = image.summaryMode;
+    return true;
+}
+
+// Splits a line into views of its tokens, held in the line arena
+TokenList Interpreter::tokenize(std::wstring_view input) {
+    TokenList tokens(&lineArena);
+    StreamTokenizer tokenizer;
+    tokenizer.feed(input, true, tokens);
     return tokens;
 }
 
-Interpreter::Interpreter() {
+Interpreter::Interpreter(std::wostream& out, std::wostream& errors, size_t threads)
+    : pool(threads), errors(errors), output(out) {
     initBuiltIns();
+
+    // Builtins whose result depends only on their operands, by operand count;
+    // link() computes calls to them on constants once, when a word is defined
+    using G = FoldGrowth;
+    const std::tuple<const wchar_t*, uint8_t, FoldGrowth> foldable[] = {
+        {L"+", 2, G::Broadcast}, {L"-", 2, G::Broadcast}, {L"*", 2, G::Broadcast}, {L"/", 2, G::Broadcast},
+        {L"^", 2, G::Broadcast}, {L"sqrt", 1, G::None}, {L"exp", 1, G::None}, {L"log", 1, G::None},
+        {L"abs", 1, G::None}, {L"sum", 1, G::None}, {L"max", 1, G::None}, {L"min", 1, G::None},
+        {L"scan", 1, G::None}, {L"cat", 2, G::None}, {L"range", 1, G::Count}, {L"reshape", 2, G::None},
+        {L"dim", 1, G::None}, {L"take", 2, G::None}, {L"drop", 2, G::None}, {L"at", 2, G::None},
+        {L"slice", 2, G::None}, {L"transpose", 1, G::None}, {L"matmul", 2, G::Product},
+        {L"dot", 2, G::None}, {L"outer", 2, G::Product}, {L"fma", 3, G::None}};
+    foldRules.assign(builtinTable.size(), {});
+    for (auto [name, arity, growth] : foldable) {
+        foldRules[symbols[symbols.find(name)].builtin] = {arity, growth};
+    }
+    // Shuffles whose stack effect link() rewrites when they act on constants
+    const std::pair<const wchar_t*, Shuffle> shuffles[] = {
+        {L"dup", Shuffle::Dup}, {L"swap", Shuffle::Swap}, {L"clear", Shuffle::Clear}};
+    for (auto [name, shuffle] : shuffles) {
+        foldRules[symbols[symbols.find(name)].builtin].shuffle = shuffle;
+    }
+}
+
+void Interpreter::reset(const Interpreter& base) {
+    stack.clear();
+    symbols = base.symbols;
+    lazyMode = base.lazyMode;
+    summaryMode = base.summaryMode;
+    profiling = false;
+}
+
+void Interpreter::freeze() {
+    symbols.freeze();
 }
 
+namespace {
+
+// Sends this thread's array allocations to `memory` for as long as it lives.
+// Only the thread running an interpreter is pointed at its meter, and only
+// while it runs code, so pool workers and other interpreters stay out of it.
+class ArrayMemoryScope {
+public:
+    explicit ArrayMemoryScope(std::pmr::memory_resource* memory) : previous(std::exchange(arrayMemory, memory)) {}
+    ~ArrayMemoryScope() { arrayMemory = previous; }
+    ArrayMemoryScope(const ArrayMemoryScope&) = delete;
+    ArrayMemoryScope& operator=(const ArrayMemoryScope&) = delete;
+
+private:
+    std::pmr::memory_resource* previous;
+};
+
+}  // namespace
+
 void Interpreter::process(const String& input) {
-    std::vector<String> tokens = tokenize(input);
-    evaluate(tokens);
-} 
\ No newline at end of file
+    ArrayMemoryScope scope(metering ? &meter.arrays : nullptr);
+    evaluate(compile(tokenize(input)));
+    if (metering) meter.sample(stack, symbols);
+    // Everything the line still needs has been copied into Values and Code
+    lineArena.release();
+}
+
+// Compiles and runs the statements completed in `tokens`, which start with
+// `held`; with more input to come, the unfinished rest goes back into `held`
+void Interpreter::runTokens(TokenList& tokens, bool more, std::vector<String>& held) {
+    ArrayMemoryScope scope(metering ? &meter.arrays : nullptr);
+    size_t complete = tokens.size();
+    Code code = compile(tokens, false, more ? &complete : nullptr);
+    std::vector<String> next(tokens.begin() + complete, tokens.end());
+    tokens.clear();
+    evaluate(code);
+    if (metering) meter.sample(stack, symbols);
+    held = std::move(next);
+    lineArena.release();
+}
+
+namespace {
+constexpr size_t chunkSize = 65536;
+}
+
+// Runs a whole script. Input is read in fixed-size chunks and every chunk's
+// complete statements run before the next is read, so memory use follows the
+// largest single token rather than the size of the input. Lines do not split
+// statements: literals and definitions may continue onto later lines.
+void Interpreter::processStream(std::wistream& in) {
+    std::pmr::vector<wchar_t> buffer(chunkSize, &meter.tokenizer);
+    StreamTokenizer tokenizer(true);
+    std::vector<String> held;  // an unfinished statement carried to the next chunk
+
+    bool more = true;
+    while (more) {
+        in.read(buffer.data(), buffer.size());
+        size_t count = static_cast<size_t>(in.gcount());
+        bool last = count < buffer.size();
+
+        TokenList tokens(held.begin(), held.end(), &lineArena);
+        more = tokenizer.feed(std::wstring_view(buffer.data(), count), last, tokens) && !last;
+        runTokens(tokens, more, held);
+    }
+}
+
+void Interpreter::processPipelined(std::wistream& in) {
+    // One chunk's tokens, end to end in `text`; tokenizer views only last
+    // until its next feed, so the reader copies them out
+    struct Batch {
+        explicit Batch(std::pmr::memory_resource* memory) : text(memory), ends(memory) {}
+        std::pmr::wstring text;
+        std::pmr::vector<size_t> ends;
+        bool more = false;
+    };
+    BoundedQueue<Batch> batches(4);
+
+    // The output now belongs to the writer thread, so neither the reader nor
+    // the error stream may flush it through a tie
+    std::wostream* inputTie = in.tie(nullptr);
+    std::wostream* errorsTie = errors.tie(nullptr);
+    std::thread reader([&] {
+        std::pmr::vector<wchar_t> buffer(chunkSize, &meter.tokenizer);
+        StreamTokenizer tokenizer(true);
+        TokenList tokens(&meter.tokenizer);
+        bool more = true;
+        while (more) {
+            in.read(buffer.data(), buffer.size());
+            size_t count = static_cast<size_t>(in.gcount());
+            bool last = count < buffer.size();
+
+            tokens.clear();
+            more = tokenizer.feed(std::wstring_view(buffer.data(), count), last, tokens) && !last;
+            Batch batch(&meter.tokenizer);
+            batch.ends.reserve(tokens.size());
+            for (std::wstring_view token : tokens) {
+                batch.text.append(token);
+                batch.ends.push_back(batch.text.size());
+            }
+            batch.more = more;
+            batches.push(std::move(batch));
+        }
+        batches.close();
+    });
+
+    std::wstreambuf* console = errors.rdbuf(output.beginAsync(errors.rdbuf()));
+    std::vector<String> held;
+    Batch batch(&meter.tokenizer);
+    while (batches.pop(batch)) {
+        TokenList tokens(held.begin(), held.end(), &lineArena);
+        size_t start = 0;
+        for (size_t end : batch.ends) {
+            tokens.emplace_back(batch.text.data() + start, end - start);
+            start = end;
+        }
+        runTokens(tokens, batch.more, held);
+    }
+    reader.join();
+    errors.flush();
+    output.endAsync();
+    errors.rdbuf(console);
+    errors.tie(errorsTie);
+    in.tie(inputTie);
+}
\ No newline at end of file
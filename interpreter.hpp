@@ -1,36 +1,171 @@
 #pragma once
 
 #include "types.hpp"
+#include "threadpool.hpp"
+#include "tokenizer.hpp"
+#include "output.hpp"
+#include "profile.hpp"
+#include "memmeter.hpp"
 #include <iostream>
 #include <sstream>
 #include <cwctype>
 #include <locale>
 #include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+#include <filesystem>
 
 class Interpreter {
 private:
+    // First, so it outlives the values whose elements it counted
+    MemoryMeter meter;
     Stack stack;
-    FunctionDict functions;
-    std::unordered_map<String, BuiltInFunc> builtIns;
+    SymbolTable symbols;
+    std::vector<BuiltInFunc> builtinTable;
+    // How link() may fold a builtin applied to constants: the operands it takes
+    // (0 if it is never folded), and whether its result can have more elements
+    // than they do, by broadcasting them, by combining every pair or by taking
+    // the count from its operand. A shuffle builtin instead says which stack
+    // rewrite simplifyStack may apply to it.
+    enum class FoldGrowth : uint8_t { None, Broadcast, Product, Count };
+    enum class Shuffle : uint8_t { None, Dup, Swap, Clear };
+    struct FoldRule {
+        uint8_t arity = 0;
+        FoldGrowth growth = FoldGrowth::None;
+        Shuffle shuffle = Shuffle::None;
+    };
+    std::vector<FoldRule> foldRules;  // per builtin
+    ThreadPool pool;  // workers for the data-parallel builtins
+    bool lazyMode = false;  // defer elementwise ops for fusion (:lazy on)
+    bool summaryMode = false;  // abbreviate big arrays when printing (:summary on)
+    std::wostream& errors;  // where error messages go
+    Output output;
+    Profiler profiler;
+
+    // Callers of the words being run, innermost last (see evaluate)
+    struct Frame {
+        const Code* code;
+        size_t pc;
+    };
+    std::vector<Frame> returnStack;
+    static constexpr size_t maxCallDepth = 1 << 20;
+    bool profiling = false;  // record calls in profiler (:profile on)
+    bool metering = false;   // meter builtins and sample memory use (:mem on)
+    bool reference = false;  // fast paths off (useReferencePaths)
+
+    // Dense arrays above summaryThreshold elements print at most summaryEdge
+    // entries from each end of every axis while summaryMode is on
+    static constexpr size_t summaryThreshold = 1000;
+    static constexpr size_t summaryEdge = 3;
+
+    // Bump allocator for per-line temporaries such as token lists, reset after
+    // every line; it only falls back to the heap for very long lines
+    std::array<std::byte, 16384> lineBuffer;
+    std::pmr::monotonic_buffer_resource lineArena{lineBuffer.data(), lineBuffer.size(), &meter.tokenizer};
 
     // Helper functions
-    bool isNumber(const String& token);
-    bool isWChar(const String& token);
-    bool isStringLiteral(const String& token);
-    bool isArrayLiteral(const String& token);
-    bool isFunctionName(const String& token);
-    std::vector<String> parseArrayTokens(const String& input);
-    Element parseElement(const String& token);
-    Array parseArray(const String& token);
+    bool isNumber(std::wstring_view token);
+    bool isWChar(std::wstring_view token);
+    bool isStringLiteral(std::wstring_view token);
+    bool isArrayLiteral(std::wstring_view token);
+    bool isFunctionName(std::wstring_view token);
+    TokenList parseArrayTokens(std::wstring_view input);
+    Element parseElement(std::wstring_view token);
+    Array parseArray(std::wstring_view token);
+    bool parseDenseLiteral(std::wstring_view token, NDArray& out);
+    Value parseValue(std::wstring_view token);
     void printArray(const Array& arr, int indent = 0);
+    void printArray(const NDArray& arr, int indent = 0);
+    void printArray(const Text& text);
+    void printDense(const NDArray& arr, size_t axis, size_t offset, int indent, bool summarize);
+    void printValue(const Value& value);
     void getShape(const Array& arr, std::vector<size_t>& shape);
+    bool toDense(const Array& arr, NDArray& out);
+    bool makeDense(Value& value, bool views = false);
+    bool makeText(Value& value);
+    Array toNested(const NDArray& arr);
+    Array toNested(const Text& text);
+    Array toNested(const Value& value);
+    Array takeNested(Value& value);
     bool shapesEqual(const std::vector<size_t>& shape1, const std::vector<size_t>& shape2);
-    void applyBinaryOp(Stack& s, const String& opName, std::function<double(double, double)> op);
+    bool hasZero(const NDArray& arr);
+    template <typename Op>
+    bool applyNested(const Array& x, const Array& y, const std::vector<size_t>& shape, size_t axis,
+        std::wstring_view opName, Array& res);
+    template <typename Op>
+    void applyBinaryOp(Stack& s, std::wstring_view opName);
+    template <typename Op>
+    void applyUnaryOp(Stack& s, std::wstring_view opName);
+    bool popPath(Stack& s, std::wstring_view opName, std::filesystem::path& path);
+    template <typename Op>
+    void applyReduction(Stack& s, std::wstring_view opName);
+    template <typename Op>
+    void applyScan(Stack& s, std::wstring_view opName);
+    bool popInteger(Stack& s, std::wstring_view opName, long long& n);
+    size_t itemCount(Value& value);
+    Value items(Value value, size_t first, size_t count);
+    Value itemAt(Value value, size_t index);
+    void applyTake(Stack& s, std::wstring_view opName, bool drop);
+    void defineBuiltIn(const String& name, BuiltInFunc func);
     void initBuiltIns();
-    void evaluate(const std::vector<String>& tokens, bool isFunctionBody = false);
-    std::vector<String> tokenize(const String& input);
+    uint32_t addConstant(Code& code, Value value);
+    void compileToken(Code& code, std::wstring_view token);
+    Code compile(const TokenList& tokens, bool isFunctionBody = false, size_t* complete = nullptr);
+    void dumpStack();
+    void defineWord(uint32_t id, std::shared_ptr<const Code> source);
+    Code link(const Code& source, uint32_t self);
+    bool foldConstants(Code& code, uint32_t symbol, uint32_t self);
+    void simplifyStack(Code& code, uint32_t symbol, uint32_t self);
+    void addDependent(uint32_t symbol, uint32_t dependent);
+    void evaluate(const Code& code);
+    void runTokens(TokenList& tokens, bool more, std::vector<String>& held);
+    void runBuiltin(uint32_t symbol, uint32_t builtin);
+    enum ProfileCommand : uint32_t { ProfileOff, ProfileOn, ProfileReport, ProfileFolded };
+    void profileCommand(uint32_t command, const String* path);
+    enum MemoryCommand : uint32_t { MemoryOff, MemoryOn, MemoryReport, MemoryJson };
+    void memoryCommand(uint32_t command, const String* path);
+    void saveImage(const String& path);
+    TokenList tokenize(std::wstring_view input);
 
 public:
-    Interpreter();
+    // Prints to `out` and reports errors to `errors`; `threads` sizes the pool
+    // the data-parallel builtins share
+    explicit Interpreter(std::wostream& out = std::wcout, std::wostream& errors = std::wcerr,
+        size_t threads = ThreadPool::defaultThreadCount());
+
+    // Starts over with base's words and modes and an empty stack. Compiled
+    // words are shared with base rather than copied; they are immutable, so
+    // interpreters on other threads may run them at the same time. Costs only
+    // what base has defined since its last freeze().
+    void reset(const Interpreter& base);
+
+    // Moves the symbol table into a frozen base that reset() from this
+    // interpreter shares instead of copying
+    void freeze();
+
+    // Takes the words, modes and stack saved in an image (see image.hpp),
+    // keeping other words; false after reporting why it cannot be read
+    bool loadImage(const std::filesystem::path& path);
+
+    // Runs without the fast paths that have a general equivalent: literals go
+    // through parseArray instead of parseDenseLiteral, and words run as
+    // compiled, without inlining or folding. siclang-fuzz checks that both
+    // ways give the same results. Call it before defining any words.
+    void useReferencePaths() { reference = true; }
+
+    // Turns memory metering on, as `:mem on` does
+    void meterMemory();
+    // Writes the `:mem` figures to `path` as JSON; false after reporting why
+    // it cannot
+    bool writeMemory(const std::filesystem::path& path);
+
     void process(const String& input);
+    void processStream(std::wistream& in);
+
+    // processStream with reading and tokenizing on one thread and writing the
+    // output on another, so evaluation never waits for either. Output and
+    // errors appear exactly as with processStream.
+    void processPipelined(std::wistream& in);
 }; 
\ No newline at end of file
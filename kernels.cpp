@@ -0,0 +1,105 @@
+#include "kernels.hpp"
+
+// Built with -O3 (see Makefile) so these loops are auto-vectorized. Each
+// aliasing case gets its own loop so the compiler does not need runtime
+// overlap checks, which would fall back to scalar code when out == a.
+template <typename Op>
+void binaryKernel(const double* a, bool aScalar, const double* b, bool bScalar, double* out, size_t n) {
+    Op op;
+    if (aScalar && bScalar) {
+        for (size_t i = 0; i < n; ++i) out[i] = op(a[0], b[0]);
+    }
+    else if (aScalar) {
+        const double x = a[0];
+        if (out == b) {
+            for (size_t i = 0; i < n; ++i) out[i] = op(x, out[i]);
+        }
+        else {
+            const double* __restrict src = b;
+            double* __restrict dst = out;
+            for (size_t i = 0; i < n; ++i) dst[i] = op(x, src[i]);
+        }
+    }
+    else if (bScalar) {
+        const double y = b[0];
+        if (out == a) {
+            for (size_t i = 0; i < n; ++i) out[i] = op(out[i], y);
+        }
+        else {
+            const double* __restrict src = a;
+            double* __restrict dst = out;
+            for (size_t i = 0; i < n; ++i) dst[i] = op(src[i], y);
+        }
+    }
+    else if (out == a) {
+        const double* __restrict src = b;
+        for (size_t i = 0; i < n; ++i) out[i] = op(out[i], src[i]);
+    }
+    else if (out == b) {
+        const double* __restrict src = a;
+        for (size_t i = 0; i < n; ++i) out[i] = op(src[i], out[i]);
+    }
+    else {
+        const double* __restrict x = a;
+        const double* __restrict y = b;
+        double* __restrict dst = out;
+        for (size_t i = 0; i < n; ++i) dst[i] = op(x[i], y[i]);
+    }
+}
+
+template void binaryKernel<AddOp>(const double*, bool, const double*, bool, double*, size_t);
+template void binaryKernel<SubOp>(const double*, bool, const double*, bool, double*, size_t);
+template void binaryKernel<MulOp>(const double*, bool, const double*, bool, double*, size_t);
+template void binaryKernel<DivOp>(const double*, bool, const double*, bool, double*, size_t);
+template void binaryKernel<PowOp>(const double*, bool, const double*, bool, double*, size_t);
+
+template <typename Op>
+void unaryKernel(const double* in, double* out, size_t n) {
+    Op op;
+    if (out == in) {
+        for (size_t i = 0; i < n; ++i) out[i] = op(out[i]);
+    }
+    else {
+        const double* __restrict src = in;
+        double* __restrict dst = out;
+        for (size_t i = 0; i < n; ++i) dst[i] = op(src[i]);
+    }
+}
+
+template void unaryKernel<SqrtOp>(const double*, double*, size_t);
+template void unaryKernel<ExpOp>(const double*, double*, size_t);
+template void unaryKernel<LogOp>(const double*, double*, size_t);
+template void unaryKernel<AbsOp>(const double*, double*, size_t);
+
+void fmaKernel(const double* a, bool aScalar, const double* b, bool bScalar, const double* c, bool cScalar,
+               double* out, size_t n) {
+    size_t aStep = aScalar ? 0 : 1, bStep = bScalar ? 0 : 1, cStep = cScalar ? 0 : 1;
+    for (size_t i = 0; i < n; ++i) out[i] = std::fma(a[i * aStep], b[i * bStep], c[i * cStep]);
+}
+
+double dotKernel(const double* a, const double* b, size_t n) {
+    double acc[8] = {};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (size_t j = 0; j < 8; ++j) acc[j] += a[i + j] * b[i + j];
+    }
+    for (; i < n; ++i) acc[0] += a[i] * b[i];
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+void gemmMicroKernel(size_t kc, const double* a, const double* b, double* c, size_t ldc) {
+    double acc[gemmMicroRows][gemmMicroCols];
+    for (size_t r = 0; r < gemmMicroRows; ++r) {
+        for (size_t j = 0; j < gemmMicroCols; ++j) acc[r][j] = c[r * ldc + j];
+    }
+    for (size_t p = 0; p < kc; ++p) {
+        for (size_t r = 0; r < gemmMicroRows; ++r) {
+            for (size_t j = 0; j < gemmMicroCols; ++j) acc[r][j] += a[r] * b[j];
+        }
+        a += gemmMicroRows;
+        b += gemmMicroCols;
+    }
+    for (size_t r = 0; r < gemmMicroRows; ++r) {
+        for (size_t j = 0; j < gemmMicroCols; ++j) c[r * ldc + j] = acc[r][j];
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "simd.hpp"
+#include <cmath>
+#include <cstddef>
+
+// Elementwise operator functors. Kernels are templates over these, so every
+// operator gets its own inlined inner loop instead of a std::function call.
+// checkZeroDivisor tells the caller to reject zero right-hand operands once,
+// before the kernel runs.
+struct AddOp {
+    static constexpr bool checkZeroDivisor = false;
+    double operator()(double x, double y) const { return x + y; }
+};
+
+struct SubOp {
+    static constexpr bool checkZeroDivisor = false;
+    double operator()(double x, double y) const { return x - y; }
+};
+
+struct MulOp {
+    static constexpr bool checkZeroDivisor = false;
+    double operator()(double x, double y) const { return x * y; }
+};
+
+struct DivOp {
+    static constexpr bool checkZeroDivisor = true;
+    double operator()(double x, double y) const { return x / y; }
+};
+
+struct PowOp {
+    static constexpr bool checkZeroDivisor = false;
+    double operator()(double x, double y) const { return std::pow(x, y); }
+};
+
+// fmax/fmin skip NaN operands, so a reduction gives the same answer whatever
+// order it combines elements in
+struct MaxOp {
+    static constexpr bool checkZeroDivisor = false;
+    double operator()(double x, double y) const { return std::fmax(x, y); }
+};
+
+struct MinOp {
+    static constexpr bool checkZeroDivisor = false;
+    double operator()(double x, double y) const { return std::fmin(x, y); }
+};
+
+struct SqrtOp {
+    double operator()(double x) const { return std::sqrt(x); }
+};
+
+struct ExpOp {
+    double operator()(double x) const { return std::exp(x); }
+};
+
+struct LogOp {
+    double operator()(double x) const { return std::log(x); }
+};
+
+struct AbsOp {
+    double operator()(double x) const { return std::fabs(x); }
+};
+
+// out[i] = op(a[i], b[i]) for n contiguous elements. A scalar operand is read
+// once and broadcast. `out` may be the same buffer as `a` or `b`.
+template <typename Op>
+void binaryKernel(const double* a, bool aScalar, const double* b, bool bScalar, double* out, size_t n);
+
+extern template void binaryKernel<AddOp>(const double*, bool, const double*, bool, double*, size_t);
+extern template void binaryKernel<SubOp>(const double*, bool, const double*, bool, double*, size_t);
+extern template void binaryKernel<MulOp>(const double*, bool, const double*, bool, double*, size_t);
+extern template void binaryKernel<DivOp>(const double*, bool, const double*, bool, double*, size_t);
+extern template void binaryKernel<PowOp>(const double*, bool, const double*, bool, double*, size_t);
+
+// out[i] = op(in[i]) for n contiguous elements; `out` may be `in`
+template <typename Op>
+void unaryKernel(const double* in, double* out, size_t n);
+
+extern template void unaryKernel<SqrtOp>(const double*, double*, size_t);
+extern template void unaryKernel<ExpOp>(const double*, double*, size_t);
+extern template void unaryKernel<LogOp>(const double*, double*, size_t);
+extern template void unaryKernel<AbsOp>(const double*, double*, size_t);
+
+// Portable FmaKernelFn, through std::fma so every variant rounds alike
+void fmaKernel(const double* a, bool aScalar, const double* b, bool bScalar, const double* c, bool cScalar,
+               double* out, size_t n);
+
+// Portable DotKernelFn, with eight interleaved accumulators and separate
+// multiplies and adds
+double dotKernel(const double* a, const double* b, size_t n);
+
+// Portable GEMM micro-kernel (see GemmMicroKernelFn) on a 4 x 4 tile, using
+// separate multiplies and adds
+constexpr size_t gemmMicroRows = 4;
+constexpr size_t gemmMicroCols = 4;
+void gemmMicroKernel(size_t kc, const double* a, const double* b, double* c, size_t ldc);
+
+// Kernel to run for Op: the runtime-dispatched SIMD variant where one exists,
+// otherwise the portable template. exp, log and pow have no vector instruction
+// and keep libm's results through the portable path.
+template <typename Op> BinaryKernelFn binaryKernelFor() { return binaryKernel<Op>; }
+template <> inline BinaryKernelFn binaryKernelFor<AddOp>() { return simdKernels().add; }
+template <> inline BinaryKernelFn binaryKernelFor<SubOp>() { return simdKernels().sub; }
+template <> inline BinaryKernelFn binaryKernelFor<MulOp>() { return simdKernels().mul; }
+template <> inline BinaryKernelFn binaryKernelFor<DivOp>() { return simdKernels().div; }
+
+template <typename Op> UnaryKernelFn unaryKernelFor() { return unaryKernel<Op>; }
+template <> inline UnaryKernelFn unaryKernelFor<SqrtOp>() { return simdKernels().sqrt; }
+template <> inline UnaryKernelFn unaryKernelFor<AbsOp>() { return simdKernels().abs; }
@@ -0,0 +1,71 @@
+#include "lexer.hpp"
+#include <charconv>
+#include <cmath>
+#include <cwctype>
+#include <string>
+
+namespace {
+
+bool isNumberChar(wchar_t c) {
+    return (c >= L'0' && c <= L'9') || (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z') ||
+        c == L'.' || c == L'+' || c == L'-' || c == L'(' || c == L')' || c == L'_';
+}
+
+bool isHexDigit(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+} // namespace
+
+bool parseNumber(const wchar_t* begin, const wchar_t* end, double& value) {
+    const wchar_t* p = begin;
+    while (p != end && std::iswspace(*p)) ++p;
+
+    bool negative = false;
+    if (p != end && (*p == L'+' || *p == L'-')) {
+        negative = *p == L'-';
+        ++p;
+    }
+
+    // std::from_chars only reads narrow characters, so copy out the ASCII run
+    // that could belong to a number. Short literals stay in the local buffer.
+    char local[64];
+    std::string spill;
+    const wchar_t* q = p;
+    while (q != end && isNumberChar(*q)) ++q;
+    size_t length = static_cast<size_t>(q - p);
+    char* text = local;
+    if (length > sizeof(local)) {
+        spill.resize(length);
+        text = &spill[0];
+    }
+    for (size_t i = 0; i < length; ++i) {
+        text[i] = static_cast<char>(p[i]);
+    }
+    const char* last = text + length;
+
+    if (length == 0 || text[0] == '+' || text[0] == '-') {
+        return false;
+    }
+
+    double result = 0.0;
+    std::errc ec;
+    if (length >= 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        // A bare "0x" prefix without hex digits still parses as the leading 0
+        bool hasDigits = length > 2 && (isHexDigit(text[2]) || (text[2] == '.' && length > 3 && isHexDigit(text[3])));
+        ec = hasDigits ? std::from_chars(text + 2, last, result, std::chars_format::hex).ec : std::errc();
+    }
+    else {
+        ec = std::from_chars(text, last, result).ec;
+    }
+    if (ec != std::errc()) {
+        return false;
+    }
+    // std::stod also rejects results that underflow into the subnormal range
+    if (result != 0.0 && !std::isnormal(result) && !std::isinf(result) && !std::isnan(result)) {
+        return false;
+    }
+
+    value = negative ? -result : result;
+    return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "types.hpp"
+#include <string_view>
+
+// Parses the longest numeric prefix of [begin, end) with the same rules as
+// std::stod (leading whitespace, sign, decimal, hex, inf and nan forms) but
+// without exceptions. Returns false when no number starts there or when the
+// value is out of range, which is exactly when std::stod would throw.
+bool parseNumber(const wchar_t* begin, const wchar_t* end, double& value);
+
+inline bool parseNumber(std::wstring_view token, double& value) {
+    return parseNumber(token.data(), token.data() + token.size(), value);
+}
@@ -1,12 +1,41 @@
 #include "interpreter.hpp"
+#include "batch.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 
-int main()
+// Runs a script file into `interp`; false if it cannot be opened
+static bool runScript(Interpreter& interp, const char* path) {
+    std::wifstream script(path);
+    if (!script) {
+        std::wcerr << L"Error: Cannot open " << path << std::endl;
+        return false;
+    }
+    script.imbue(std::locale());
+    interp.processPipelined(script);
+    return true;
+}
+
+// Writes the memory figures if `--mem` asked for them; `status` unless that fails
+static int finish(Interpreter& interp, const char* memoryPath, int status) {
+    if (memoryPath && !interp.writeMemory(memoryPath)) return 1;
+    return status;
+}
+
+int main(int argc, char* argv[])
 {
+    // Output is buffered by the interpreter (see output.hpp); without stdio
+    // syncing the streams keep their own buffers too instead of passing every
+    // character through to C stdio. wcin and wcerr stay tied to wcout, so
+    // prompts and errors still appear in order.
+    std::ios::sync_with_stdio(false);
+
     // Attempt to set locale for Unicode support
     try {
         std::locale::global(std::locale("en_US.UTF-8"));
         std::wcout.imbue(std::locale());
+        std::wcerr.imbue(std::locale());
         std::wcin.imbue(std::locale());
     }
     catch (const std::runtime_error& e) {
@@ -15,10 +44,80 @@ int main()
         // Use default locale
         std::locale::global(std::locale(""));
         std::wcout.imbue(std::locale());
+        std::wcerr.imbue(std::locale());
         std::wcin.imbue(std::locale());
     }
 
+    // `siclang --image FILE ...` starts from the words, modes and stack saved
+    // with `:save-image FILE`; `--mem FILE` meters memory from the start and
+    // writes the `:mem` figures to FILE as JSON at exit. Either way the run
+    // then carries on as if the option were absent.
+    const char* imagePath = nullptr;
+    const char* memoryPath = nullptr;
+    while (argc > 1 && (std::strcmp(argv[1], "--image") == 0 || std::strcmp(argv[1], "--mem") == 0)) {
+        bool image = std::strcmp(argv[1], "--image") == 0;
+        if (argc < 3) {
+            std::wcerr << L"Error: " << argv[1] << L" needs a file" << std::endl;
+            return 1;
+        }
+        (image ? imagePath : memoryPath) = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
+    // Batch mode: `siclang --batch DIR [-j N] [--prelude FILE]` runs every file
+    // in DIR as its own script, N at a time, each starting with the words
+    // FILE defines
+    if (argc > 1 && std::strcmp(argv[1], "--batch") == 0) {
+        if (argc < 3) {
+            std::wcerr << L"Error: --batch needs a directory" << std::endl;
+            return 1;
+        }
+        size_t jobs = ThreadPool::defaultThreadCount();
+        const char* preludePath = nullptr;
+        for (int i = 3; i < argc; ++i) {
+            if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                long n = std::strtol(argv[++i], nullptr, 10);
+                if (n <= 0) {
+                    std::wcerr << L"Error: -j needs a positive number" << std::endl;
+                    return 1;
+                }
+                jobs = static_cast<size_t>(n);
+            }
+            else if (std::strcmp(argv[i], "--prelude") == 0 && i + 1 < argc) {
+                preludePath = argv[++i];
+            }
+            else {
+                std::wcerr << L"Error: Unknown option " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        Interpreter prelude;
+        if (memoryPath) prelude.meterMemory();
+        if (imagePath && !prelude.loadImage(imagePath)) {
+            return 1;
+        }
+        if (preludePath && !runScript(prelude, preludePath)) {
+            return 1;
+        }
+        return finish(prelude, memoryPath, runBatch(argv[2], jobs, prelude) ? 0 : 1);
+    }
+
     Interpreter interp;
+    if (memoryPath) interp.meterMemory();
+    if (imagePath && !interp.loadImage(imagePath)) {
+        return 1;
+    }
+
+    // Script mode: `siclang script.sic`, or `siclang -` to read standard input
+    if (argc > 1) {
+        if (std::string(argv[1]) == "-") {
+            interp.processPipelined(std::wcin);
+            return finish(interp, memoryPath, 0);
+        }
+        return finish(interp, memoryPath, runScript(interp, argv[1]) ? 0 : 1);
+    }
+
     String line;
 
     std::wcout << L"SIC Lang - Simple Interpreted Concatenative Lang\n";
@@ -26,10 +125,9 @@ int main()
 
     while (true) {
         std::wcout << L"> ";
-        std::getline(std::wcin, line);
-        if (line == L"exit") break;
+        if (!std::getline(std::wcin, line) || line == L"exit") break;
         interp.process(line);
     }
 
-    return 0;
+    return finish(interp, memoryPath, 0);
 }
@@ -0,0 +1,242 @@
+#include "memmeter.hpp"
+#include "fusion.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <unordered_set>
+
+void* CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    void* p = upstream->allocate(bytes, alignment);
+    count.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(bytes, std::memory_order_relaxed);
+    raisePeak(current.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    return p;
+}
+
+void CountingResource::raisePeak(uint64_t bytes) {
+    uint64_t peak = highest.load(std::memory_order_relaxed);
+    while (bytes > peak && !highest.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+    }
+}
+
+void CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    current.fetch_sub(bytes, std::memory_order_relaxed);
+    upstream->deallocate(p, bytes, alignment);
+}
+
+namespace {
+
+// Storage already counted; anything shared between values counts once
+using Seen = std::unordered_set<const void*>;
+
+uint64_t stringBytes(const String& s) {
+    const void* p = s.data();
+    bool local = p >= static_cast<const void*>(&s) && p < static_cast<const void*>(&s + 1);
+    return local ? 0 : (s.capacity() + 1) * sizeof(wchar_t);
+}
+
+uint64_t arrayBytes(const Array& arr) {
+    uint64_t n = arr.capacity() * sizeof(Element);
+    for (const Element& e : arr) {
+        if (const String* s = std::get_if<String>(&e)) n += stringBytes(*s);
+        else if (const Array* a = std::get_if<Array>(&e)) n += arrayBytes(*a);
+    }
+    return n;
+}
+
+uint64_t valueBytes(const Value& value, Seen& seen) {
+    if (value.scalar() || !seen.insert(value.payload()).second) return 0;
+    uint64_t n = value.payloadBytes();
+    if (value.lazy()) {
+        const LazyExpr& expr = value.expr();
+        if (!seen.insert(&expr).second) return n;
+        n += sizeof(LazyExpr) + expr.operands.capacity() * sizeof(Value) + expr.shape.capacity() * sizeof(size_t);
+        for (const Value& operand : expr.operands) n += valueBytes(operand, seen);
+    }
+    else if (value.holds<NDArray>()) {
+        const NDArray& arr = value.get<NDArray>();
+        n += (arr.shape.capacity() + arr.strides.capacity()) * sizeof(size_t);
+        if (arr.data.storage() && seen.insert(arr.data.storage()).second) n += arr.data.storageBytes();
+    }
+    else if (value.holds<Text>()) {
+        n += value.get<Text>().heapBytes();
+    }
+    else {
+        n += arrayBytes(value.get<Array>());
+    }
+    return n;
+}
+
+uint64_t codeBytes(const Code* code, Seen& seen) {
+    if (!code || !seen.insert(code).second) return 0;
+    uint64_t n = sizeof(Code) + code->instructions.capacity() * sizeof(Instruction) +
+                 code->constants.capacity() * sizeof(Value) +
+                 code->bodies.capacity() * sizeof(std::shared_ptr<const Code>) +
+                 code->messages.capacity() * sizeof(String);
+    for (const Value& constant : code->constants) n += valueBytes(constant, seen);
+    for (const auto& body : code->bodies) n += codeBytes(body.get(), seen);
+    for (const String& message : code->messages) n += stringBytes(message);
+    return n;
+}
+
+void putPadded(Output& out, std::wstring_view text, size_t width, bool right) {
+    size_t pad = text.size() < width ? width - text.size() : 0;
+    if (right) out.put(String(pad, L' '));
+    out.put(text);
+    if (!right) out.put(String(pad, L' '));
+}
+
+// One report row; UINT64_MAX marks a figure the category does not have
+void putRow(Output& out, std::wstring_view name, std::initializer_list<uint64_t> figures) {
+    putPadded(out, name, 12, false);
+    for (uint64_t figure : figures) {
+        putPadded(out, figure == UINT64_MAX ? L"-" : std::to_wstring(figure), 14, true);
+    }
+    out.put(L'\n');
+}
+
+std::string jsonString(const String& text) {
+    std::string out = "\"";
+    for (wchar_t c : text) {
+        if (c == L'"' || c == L'\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        }
+        else if (c >= 0x20 && c < 0x7f) {
+            out += static_cast<char>(c);
+        }
+        else {
+            char escape[16];
+            uint32_t code = static_cast<uint32_t>(c);
+            if (code > 0xffff) {
+                code -= 0x10000;
+                std::snprintf(escape, sizeof(escape), "\\u%04x\\u%04x", 0xd800 + (code >> 10), 0xdc00 + (code & 0x3ff));
+            }
+            else {
+                std::snprintf(escape, sizeof(escape), "\\u%04x", code);
+            }
+            out += escape;
+        }
+    }
+    return out + "\"";
+}
+
+}  // namespace
+
+void MemoryMeter::reset() {
+    stack = {};
+    words = {};
+    temporaries = {};
+    stats.clear();
+}
+
+void MemoryMeter::enter() {
+    frames.push_back({arrays.allocations(), arrays.bytes(), arrays.live(), arrays.restartPeak()});
+}
+
+void MemoryMeter::leave(uint32_t symbol) {
+    if (frames.empty()) return;
+    Frame frame = frames.back();
+    frames.pop_back();
+    uint64_t peak = arrays.peak();
+    uint64_t held = peak > frame.live ? peak - frame.live : 0;
+    arrays.raisePeak(frame.outerPeak);
+
+    if (stats.size() <= symbol) stats.resize(symbol + 1);
+    for (Stats* s : {&stats[symbol], &temporaries}) {
+        ++s->calls;
+        s->allocations += arrays.allocations() - frame.allocations;
+        s->bytes += arrays.bytes() - frame.bytes;
+        s->peak = std::max(s->peak, held);
+    }
+}
+
+void MemoryMeter::sample(const Stack& values, const SymbolTable& symbols) {
+    Seen seen;
+    stack.items = values.size();
+    stack.live = values.capacity() * sizeof(Value);
+    for (const Value& value : values) stack.live += valueBytes(value, seen);
+    stack.peak = std::max(stack.peak, stack.live);
+
+    seen.clear();
+    words.items = 0;
+    words.live = symbols.size() * sizeof(Symbol);
+    for (uint32_t id = 0; id < symbols.size(); ++id) {
+        const Symbol& symbol = symbols[id];
+        if (symbol.source) ++words.items;
+        words.live += codeBytes(symbol.source.get(), seen) + codeBytes(symbol.body.get(), seen) +
+                      symbols.dependents(id).capacity() * sizeof(uint32_t) + stringBytes(symbols.name(id));
+    }
+    words.peak = std::max(words.peak, words.live);
+}
+
+void MemoryMeter::report(Output& out, const SymbolTable& symbols) const {
+    constexpr uint64_t none = UINT64_MAX;
+    out.put(L"Memory:\n");
+    putPadded(out, L"category", 12, false);
+    out.put(L"         items          live          peak   allocations         bytes\n");
+    putRow(out, L"arrays", {none, arrays.live(), arrays.peak(), arrays.allocations(), arrays.bytes()});
+    putRow(out, L"stack", {stack.items, stack.live, stack.peak, none, none});
+    putRow(out, L"words", {words.items, words.live, words.peak, none, none});
+    putRow(out, L"tokenizer", {none, tokenizer.live(), tokenizer.peak(), tokenizer.allocations(), tokenizer.bytes()});
+    putRow(out, L"temporaries", {temporaries.calls, none, temporaries.peak, temporaries.allocations, temporaries.bytes});
+
+    std::vector<uint32_t> called;
+    size_t width = 7;
+    for (uint32_t id = 0; id < stats.size(); ++id) {
+        if (stats[id].calls == 0) continue;
+        called.push_back(id);
+        width = std::max(width, symbols.name(id).size());
+    }
+    if (called.empty()) return;
+    std::sort(called.begin(), called.end(), [&](uint32_t a, uint32_t b) { return stats[a].bytes > stats[b].bytes; });
+    putPadded(out, L"builtin", width, false);
+    out.put(L"         calls   allocations         bytes          peak\n");
+    for (uint32_t id : called) {
+        const Stats& s = stats[id];
+        putPadded(out, symbols.name(id), width, false);
+        putPadded(out, std::to_wstring(s.calls), 14, true);
+        putPadded(out, std::to_wstring(s.allocations), 14, true);
+        putPadded(out, std::to_wstring(s.bytes), 14, true);
+        putPadded(out, std::to_wstring(s.peak), 14, true);
+        out.put(L'\n');
+    }
+}
+
+bool MemoryMeter::writeJson(const std::filesystem::path& path, const SymbolTable& symbols, String& error) const {
+    std::ofstream file(path);
+    if (!file) {
+        error = L"Cannot open " + path.wstring();
+        return false;
+    }
+    // main() sets the global locale to the user's, whose digit grouping would
+    // turn the numbers into invalid JSON
+    file.imbue(std::locale::classic());
+    file << "{\n"
+         << "  \"arrays\": {\"live\": " << arrays.live() << ", \"peak\": " << arrays.peak()
+         << ", \"allocations\": " << arrays.allocations() << ", \"bytes\": " << arrays.bytes() << "},\n"
+         << "  \"stack\": {\"values\": " << stack.items << ", \"live\": " << stack.live
+         << ", \"peak\": " << stack.peak << "},\n"
+         << "  \"words\": {\"words\": " << words.items << ", \"live\": " << words.live
+         << ", \"peak\": " << words.peak << "},\n"
+         << "  \"tokenizer\": {\"live\": " << tokenizer.live() << ", \"peak\": " << tokenizer.peak()
+         << ", \"allocations\": " << tokenizer.allocations() << ", \"bytes\": " << tokenizer.bytes() << "},\n"
+         << "  \"temporaries\": {\"calls\": " << temporaries.calls << ", \"peak\": " << temporaries.peak
+         << ", \"allocations\": " << temporaries.allocations << ", \"bytes\": " << temporaries.bytes << "},\n"
+         << "  \"builtins\": [";
+    const char* separator = "\n";
+    for (uint32_t id = 0; id < stats.size(); ++id) {
+        const Stats& s = stats[id];
+        if (s.calls == 0) continue;
+        file << separator << "    {\"name\": " << jsonString(symbols.name(id)) << ", \"calls\": " << s.calls
+             << ", \"allocations\": " << s.allocations << ", \"bytes\": " << s.bytes << ", \"peak\": " << s.peak
+             << "}";
+        separator = ",\n";
+    }
+    file << (*separator == ',' ? "\n  ]\n}\n" : "]\n}\n");
+    if (!file.flush()) {
+        error = L"Cannot write " + path.wstring();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "types.hpp"
+#include "output.hpp"
+#include <atomic>
+#include <filesystem>
+#include <memory_resource>
+#include <vector>
+
+// Memory resource that passes every request on to `upstream` and keeps heap
+// figures for what goes through it. Safe to share between threads.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : upstream(upstream) {}
+
+    uint64_t allocations() const { return count.load(std::memory_order_relaxed); }
+    uint64_t bytes() const { return total.load(std::memory_order_relaxed); }
+    uint64_t live() const { return current.load(std::memory_order_relaxed); }
+    uint64_t peak() const { return highest.load(std::memory_order_relaxed); }
+
+    // Starts a new peak at the current live total; returns the peak until now
+    uint64_t restartPeak() { return highest.exchange(live(), std::memory_order_relaxed); }
+
+    // Makes the peak at least `bytes`, to resume a measurement restartPeak cut short
+    void raisePeak(uint64_t bytes);
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::pmr::memory_resource* upstream;
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> current{0};
+    std::atomic<uint64_t> highest{0};
+};
+
+// Memory use by category, as `:mem` reports it:
+//   arrays       array elements allocated while this interpreter ran code
+//   stack        what the stack's values keep alive
+//   words        compiled code of the defined words, source and linked
+//   tokenizer    input chunks, token lists and the line arena's overflow
+//   temporaries  array elements allocated by builtins, and the most any one
+//                call held at once beyond what it started with
+// Stack and words are measured by walking them, so their peaks are as of the
+// last sample(). Temporaries and the per-builtin table are only gathered
+// while metering is on: the evaluator calls enter() and leave() around each
+// builtin then.
+class MemoryMeter {
+public:
+    // Forgets the per-builtin figures and the sampled peaks
+    void reset();
+
+    void enter();
+    void leave(uint32_t symbol);
+
+    // Measures the stack and the words now, raising their peaks
+    void sample(const Stack& stack, const SymbolTable& symbols);
+
+    // Table of every category, then every builtin metered, most bytes first
+    void report(Output& out, const SymbolTable& symbols) const;
+
+    // The same figures as a JSON object
+    bool writeJson(const std::filesystem::path& path, const SymbolTable& symbols, String& error) const;
+
+    CountingResource arrays;
+    CountingResource tokenizer;
+
+private:
+    struct Measured {
+        uint64_t items = 0;
+        uint64_t live = 0;
+        uint64_t peak = 0;
+    };
+    struct Stats {
+        uint64_t calls = 0;
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+        uint64_t peak = 0;  // most held at once beyond the live total at entry
+    };
+    struct Frame {
+        uint64_t allocations;
+        uint64_t bytes;
+        uint64_t live;
+        uint64_t outerPeak;
+    };
+
+    Measured stack;
+    Measured words;
+    Stats temporaries;          // all builtins together
+    std::vector<Stats> stats;  // indexed by symbol id
+    std::vector<Frame> frames;
+};
@@ -0,0 +1,106 @@
+#include "output.hpp"
+#include <charconv>
+
+void Output::put(double value) {
+    // Longest shortest form is "-1.2345678901234567e-308"
+    char digits[32];
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    for (const char* c = digits; c != end; ++c) {
+        buffer.push_back(static_cast<wchar_t>(*c));
+    }
+    if (buffer.size() >= blockSize) write();
+}
+
+void Output::write() {
+    if (writer) {
+        if (!buffer.empty()) writer->write(buffer, false);
+    } else {
+        stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+    buffer.clear();
+}
+
+void Output::flush() {
+    write();
+    if (!writer) stream.flush();
+}
+
+std::wstreambuf* Output::beginAsync(std::wstreambuf* errors) {
+    write();
+    stream.flush();
+    writer = std::make_unique<AsyncWriter>(stream, errors);
+    return writer->errorSink();
+}
+
+void Output::endAsync() {
+    write();
+    writer.reset();
+}
+
+AsyncWriter::AsyncWriter(std::wostream& out, std::wstreambuf* errors) : out(out), errors(errors) {
+    sink.writer = this;
+    thread = std::thread([this] { run(); });
+}
+
+AsyncWriter::~AsyncWriter() {
+    sink.pubsync();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void AsyncWriter::write(std::wstring_view text, bool error) {
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [&] { return pendingChars < maxPending; });
+    pending.emplace_back(String(text), error);
+    pendingChars += text.size();
+    lock.unlock();
+    wake.notify_one();
+}
+
+void AsyncWriter::run() {
+    std::deque<std::pair<String, bool>> taken;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&] { return !pending.empty() || stopping; });
+        if (pending.empty()) break;
+        taken.swap(pending);
+        pendingChars = 0;
+        lock.unlock();
+        drained.notify_one();
+
+        for (const auto& [text, error] : taken) {
+            if (error) {
+                out.flush();
+                errors->sputn(text.data(), static_cast<std::streamsize>(text.size()));
+                errors->pubsync();
+            } else {
+                out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            }
+        }
+        taken.clear();
+        out.flush();
+        lock.lock();
+    }
+}
+
+AsyncWriter::Sink::int_type AsyncWriter::Sink::overflow(int_type c) {
+    if (!traits_type::eq_int_type(c, traits_type::eof())) text.push_back(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+}
+
+std::streamsize AsyncWriter::Sink::xsputn(const wchar_t* s, std::streamsize n) {
+    text.append(s, static_cast<size_t>(n));
+    return n;
+}
+
+int AsyncWriter::Sink::sync() {
+    if (!text.empty()) {
+        writer->write(text, true);
+        text.clear();
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "types.hpp"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <thread>
+
+// Writes text to an output stream and an error stream on a thread of its own,
+// in the order it was handed over, so the thread producing it never waits for
+// a terminal or pipe. Error text is written after flushing the output, which
+// keeps the two interleaved as they were produced when both reach the same
+// file. The output is flushed whenever the thread catches up.
+class AsyncWriter {
+public:
+    AsyncWriter(std::wostream& out, std::wstreambuf* errors);
+    ~AsyncWriter();  // writes everything still queued
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    // Queues `text`, waiting first if too much is already queued
+    void write(std::wstring_view text, bool error);
+
+    // Stream buffer that queues what is written through it as error text,
+    // each time the stream is flushed
+    std::wstreambuf* errorSink() { return &sink; }
+
+private:
+    static constexpr size_t maxPending = 1 << 20;  // characters
+
+    struct Sink : std::wstreambuf {
+        AsyncWriter* writer = nullptr;
+        String text;
+        int_type overflow(int_type c) override;
+        std::streamsize xsputn(const wchar_t* s, std::streamsize n) override;
+        int sync() override;
+    };
+
+    void run();
+
+    std::wostream& out;
+    std::wstreambuf* errors;
+    Sink sink;
+
+    std::mutex mutex;
+    std::condition_variable wake;     // writer: work queued or stopping
+    std::condition_variable drained;  // producer: room in the queue
+    std::deque<std::pair<String, bool>> pending;  // text and whether it is an error
+    size_t pendingChars = 0;
+    bool stopping = false;
+    std::thread thread;
+};
+
+// Buffered sink for everything the interpreter prints. Text collects in one
+// reusable wide buffer and reaches the stream in large blocks, so printing a
+// big array costs a few writes instead of several per element.
+class Output {
+public:
+    explicit Output(std::wostream& stream) : stream(stream) { buffer.reserve(blockSize); }
+    ~Output() { flush(); }
+
+    void put(wchar_t c) {
+        buffer.push_back(c);
+        if (buffer.size() >= blockSize) write();
+    }
+    void put(std::wstring_view text) {
+        buffer.append(text);
+        if (buffer.size() >= blockSize) write();
+    }
+
+    // Shortest text that reads back as exactly `value`
+    void put(double value);
+
+    // Two spaces per level
+    void indent(int level) { buffer.append(static_cast<size_t>(level) * 2, L' '); }
+
+    // Hands everything buffered to the stream and flushes it
+    void flush();
+
+    // Until endAsync, buffered text goes to an AsyncWriter instead of straight
+    // to the stream. Returns the writer's error sink, which `errors` should
+    // write through meanwhile so errors stay in order with the output.
+    std::wstreambuf* beginAsync(std::wstreambuf* errors);
+    // Waits for everything queued to be written
+    void endAsync();
+
+private:
+    static constexpr size_t blockSize = 65536;
+
+    void write();
+
+    std::wostream& stream;
+    String buffer;
+    std::unique_ptr<AsyncWriter> writer;
+};
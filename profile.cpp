@@ -0,0 +1,134 @@
+#include "profile.hpp"
+#ifdef SICLANG_ALLOCSTATS
+#include "allocstats.hpp"
+#endif
+#include <algorithm>
+#include <cwchar>
+#include <fstream>
+
+namespace {
+
+// Heap bytes come from the allocation hook, which is only linked in with
+// make ALLOCSTATS=1
+#ifdef SICLANG_ALLOCSTATS
+constexpr bool countsBytes = true;
+uint64_t allocatedBytes() { return allocStats().bytes; }
+#else
+constexpr bool countsBytes = false;
+uint64_t allocatedBytes() { return 0; }
+#endif
+
+}  // namespace
+
+void Profiler::reset() {
+    stats.clear();
+    frames.clear();
+    nodes.assign(1, {0, 0, 0});
+    children.clear();
+}
+
+void Profiler::enter(uint32_t symbol) {
+    if (symbol >= stats.size()) stats.resize(symbol + 1);
+    stats[symbol].calls++;
+    stats[symbol].active++;
+
+    uint32_t parent = frames.empty() ? 0 : frames.back().node;
+    auto [it, added] = children.try_emplace(uint64_t(parent) << 32 | symbol, static_cast<uint32_t>(nodes.size()));
+    if (added) nodes.push_back({symbol, parent, 0});
+
+    frames.push_back({symbol, it->second, Clock::now(), allocatedBytes(), 0});
+}
+
+void Profiler::leave() {
+    // Frames entered before the last reset have no record
+    if (frames.empty()) return;
+    Frame frame = frames.back();
+    frames.pop_back();
+
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.start).count();
+    uint64_t self = ns > frame.childNs ? ns - frame.childNs : 0;
+    Stats& s = stats[frame.symbol];
+    s.exclusiveNs += self;
+    if (--s.active == 0) {
+        s.inclusiveNs += ns;
+        s.bytes += allocatedBytes() - frame.startBytes;
+    }
+    nodes[frame.node].selfNs += self;
+    if (!frames.empty()) frames.back().childNs += ns;
+}
+
+namespace {
+
+void putPadded(Output& out, std::wstring_view text, size_t width, bool right) {
+    size_t pad = text.size() < width ? width - text.size() : 0;
+    if (right) out.put(String(pad, L' '));
+    out.put(text);
+    if (!right) out.put(String(pad, L' '));
+}
+
+String milliseconds(uint64_t ns) {
+    wchar_t text[32];
+    std::swprintf(text, 32, L"%.3f", ns / 1e6);
+    return text;
+}
+
+}  // namespace
+
+void Profiler::report(Output& out, const SymbolTable& symbols) const {
+    std::vector<uint32_t> called;
+    size_t width = 4;
+    for (uint32_t id = 0; id < stats.size(); ++id) {
+        if (stats[id].calls == 0) continue;
+        called.push_back(id);
+        width = std::max(width, symbols.name(id).size());
+    }
+    std::sort(called.begin(), called.end(), [&](uint32_t a, uint32_t b) {
+        return stats[a].exclusiveNs > stats[b].exclusiveNs;
+    });
+
+    out.put(L"Profile:\n");
+    if (called.empty()) {
+        out.put(L"(no calls)\n");
+        return;
+    }
+    putPadded(out, L"word", width, false);
+    out.put(countsBytes ? L"       calls  incl ms  excl ms        bytes\n" : L"       calls  incl ms  excl ms\n");
+    for (uint32_t id : called) {
+        const Stats& s = stats[id];
+        putPadded(out, symbols.name(id), width, false);
+        putPadded(out, std::to_wstring(s.calls), 12, true);
+        putPadded(out, milliseconds(s.inclusiveNs), 9, true);
+        putPadded(out, milliseconds(s.exclusiveNs), 9, true);
+        if (countsBytes) putPadded(out, std::to_wstring(s.bytes), 13, true);
+        out.put(L'\n');
+    }
+}
+
+bool Profiler::writeFolded(const std::filesystem::path& path, const SymbolTable& symbols, String& error) const {
+    std::wofstream file(path);
+    if (!file) {
+        error = L"Cannot open " + path.wstring();
+        return false;
+    }
+    // Names are written in the user's encoding, but numbers must not be
+    // grouped, or flamegraph.pl cannot read the weights
+    file.imbue(std::locale(std::locale::classic(), std::locale(), std::locale::ctype));
+
+    std::vector<uint32_t> stack;
+    for (uint32_t node = 1; node < nodes.size(); ++node) {
+        if (nodes[node].selfNs == 0) continue;
+        stack.clear();
+        for (uint32_t n = node; n != 0; n = nodes[n].parent) {
+            stack.push_back(nodes[n].symbol);
+        }
+        for (size_t i = stack.size(); i-- > 0;) {
+            file << symbols.name(stack[i]) << (i ? L";" : L" ");
+        }
+        file << nodes[node].selfNs << L'\n';
+    }
+    if (!file.flush()) {
+        error = L"Cannot write " + path.wstring();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "types.hpp"
+#include "output.hpp"
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+// Per-symbol statistics gathered while `:profile on` is active: calls,
+// inclusive and exclusive time, and in builds with the allocation hook
+// (make ALLOCSTATS=1) heap bytes allocated (inclusive). The evaluator calls
+// enter() before each builtin or word and leave() after it.
+// A recursive word's inclusive figures count only its outermost call.
+class Profiler {
+public:
+    // Forgets everything recorded so far
+    void reset();
+
+    void enter(uint32_t symbol);
+    void leave();
+
+    // Table of every symbol called, most exclusive time first
+    void report(Output& out, const SymbolTable& symbols) const;
+
+    // Writes one "outer;inner;leaf nanoseconds" line per distinct call
+    // stack, the folded format flamegraph.pl reads
+    bool writeFolded(const std::filesystem::path& path, const SymbolTable& symbols, String& error) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t calls = 0;
+        uint64_t inclusiveNs = 0;
+        uint64_t exclusiveNs = 0;
+        uint64_t bytes = 0;
+        uint32_t active = 0;  // calls currently on the frame stack
+    };
+    struct Frame {
+        uint32_t symbol;
+        uint32_t node;
+        Clock::time_point start;
+        uint64_t startBytes;
+        uint64_t childNs;
+    };
+    // Call-tree node for the folded output; node 0 is the root
+    struct Node {
+        uint32_t symbol;
+        uint32_t parent;
+        uint64_t selfNs;
+    };
+
+    std::vector<Stats> stats;  // indexed by symbol id
+    std::vector<Frame> frames;
+    std::vector<Node> nodes{{0, 0, 0}};
+    std::unordered_map<uint64_t, uint32_t> children;  // parent << 32 | symbol -> node
+};
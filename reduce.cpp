@@ -0,0 +1,144 @@
+#include "reduce.hpp"
+#include "kernels.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Elements per parallel work item
+constexpr size_t chunkSize = 16384;
+
+// Ranges up to this long are folded directly, with eight interleaved
+// accumulators; longer ones are split in half
+constexpr size_t pairwiseBlock = 128;
+
+template <typename Op>
+double pairwise(const double* x, size_t n) {
+    Op op;
+    if (n < 8) {
+        double r = x[0];
+        for (size_t i = 1; i < n; ++i) r = op(r, x[i]);
+        return r;
+    }
+    if (n <= pairwiseBlock) {
+        double acc[8];
+        std::copy_n(x, 8, acc);
+        size_t i = 8;
+        for (; i + 8 <= n; i += 8) {
+            for (size_t j = 0; j < 8; ++j) acc[j] = op(acc[j], x[i + j]);
+        }
+        for (; i < n; ++i) acc[0] = op(acc[0], x[i]);
+        return op(op(op(acc[0], acc[1]), op(acc[2], acc[3])), op(op(acc[4], acc[5]), op(acc[6], acc[7])));
+    }
+    size_t half = n / 2 / 8 * 8;
+    return op(pairwise<Op>(x, half), pairwise<Op>(x + half, n - half));
+}
+
+template <typename Op>
+void scanRange(const double* in, double* out, size_t n, double carry, bool hasCarry) {
+    Op op;
+    size_t i = 0;
+    if (!hasCarry) {
+        carry = in[0];
+        out[0] = carry;
+        i = 1;
+    }
+    for (; i < n; ++i) {
+        carry = op(carry, in[i]);
+        out[i] = carry;
+    }
+}
+
+// Splits `count` items of `itemSize` elements into groups of about one chunk
+size_t itemsPerGroup(size_t itemSize) {
+    return std::max<size_t>(1, chunkSize / std::max<size_t>(1, itemSize));
+}
+
+// out[r] = fold(r, begin, length) of row r's chunks, combined with Op; each
+// chunk is folded by its own work item, and rows shorter than a chunk are
+// grouped instead
+template <typename Op, typename Fold>
+void foldRows(size_t rows, size_t cols, double* out, ThreadPool& pool, const Fold& fold) {
+    size_t chunks = (cols + chunkSize - 1) / chunkSize;
+    if (chunks == 1) {
+        // Short rows: each work item reduces a group of whole rows
+        size_t group = itemsPerGroup(cols);
+        pool.parallelFor((rows + group - 1) / group, [&](size_t g) {
+            size_t end = std::min(rows, (g + 1) * group);
+            for (size_t r = g * group; r < end; ++r) out[r] = fold(r, 0, cols);
+        });
+        return;
+    }
+
+    // Long rows: fold every chunk, then combine each row's chunk results
+    std::vector<double> partial(rows * chunks);
+    pool.parallelFor(rows * chunks, [&](size_t item) {
+        size_t r = item / chunks, c = item % chunks;
+        size_t begin = c * chunkSize;
+        partial[item] = fold(r, begin, std::min(chunkSize, cols - begin));
+    });
+    for (size_t r = 0; r < rows; ++r) out[r] = pairwise<Op>(&partial[r * chunks], chunks);
+}
+
+}  // namespace
+
+template <typename Op>
+void reduceRows(const double* in, size_t rows, size_t cols, double* out, ThreadPool& pool) {
+    foldRows<Op>(rows, cols, out, pool, [&](size_t r, size_t begin, size_t length) {
+        return pairwise<Op>(in + r * cols + begin, length);
+    });
+}
+
+void dotRows(const double* a, const double* b, size_t rows, size_t cols, double* out, ThreadPool& pool) {
+    if (cols == 0) {
+        std::fill_n(out, rows, 0.0);
+        return;
+    }
+    DotKernelFn dot = simdKernels().dot;
+    foldRows<AddOp>(rows, cols, out, pool, [&](size_t r, size_t begin, size_t length) {
+        return dot(a + r * cols + begin, b + r * cols + begin, length);
+    });
+}
+
+template <typename Op>
+void scanRows(const double* in, size_t rows, size_t cols, double* out, ThreadPool& pool) {
+    if (cols == 0) return;
+    size_t chunks = (cols + chunkSize - 1) / chunkSize;
+    if (chunks == 1) {
+        size_t group = itemsPerGroup(cols);
+        pool.parallelFor((rows + group - 1) / group, [&](size_t g) {
+            size_t end = std::min(rows, (g + 1) * group);
+            for (size_t r = g * group; r < end; ++r) scanRange<Op>(in + r * cols, out + r * cols, cols, 0.0, false);
+        });
+        return;
+    }
+
+    // Long rows: total every chunk, turn the totals into each chunk's carry-in,
+    // then scan the chunks independently from their carries
+    Op op;
+    std::vector<double> carry(rows * chunks);
+    pool.parallelFor(rows * chunks, [&](size_t item) {
+        size_t r = item / chunks, c = item % chunks;
+        size_t begin = c * chunkSize;
+        carry[item] = pairwise<Op>(in + r * cols + begin, std::min(chunkSize, cols - begin));
+    });
+    for (size_t r = 0; r < rows; ++r) {
+        double* row = &carry[r * chunks];
+        double running = row[0];
+        for (size_t c = 1; c < chunks; ++c) {
+            double total = row[c];
+            row[c] = running;
+            running = op(running, total);
+        }
+    }
+    pool.parallelFor(rows * chunks, [&](size_t item) {
+        size_t r = item / chunks, c = item % chunks;
+        size_t begin = c * chunkSize;
+        scanRange<Op>(in + r * cols + begin, out + r * cols + begin, std::min(chunkSize, cols - begin), carry[item], c > 0);
+    });
+}
+
+template void reduceRows<AddOp>(const double*, size_t, size_t, double*, ThreadPool&);
+template void reduceRows<MaxOp>(const double*, size_t, size_t, double*, ThreadPool&);
+template void reduceRows<MinOp>(const double*, size_t, size_t, double*, ThreadPool&);
+template void scanRows<AddOp>(const double*, size_t, size_t, double*, ThreadPool&);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "threadpool.hpp"
+#include <cstddef>
+
+// Reductions and scans over the rows of a contiguous rows x cols matrix, for
+// Op in AddOp, MaxOp and MinOp. Rows are cut into fixed-size chunks that the
+// pool works on in parallel; inside a chunk sums are pairwise. The chunking
+// never depends on the number of threads, so results are reproducible.
+
+// out[r] = in[r][0] op in[r][1] op ... for every row; cols must be > 0
+template <typename Op>
+void reduceRows(const double* in, size_t rows, size_t cols, double* out, ThreadPool& pool);
+
+// out[r][j] = in[r][0] op ... op in[r][j]; `out` may be `in`
+template <typename Op>
+void scanRows(const double* in, size_t rows, size_t cols, double* out, ThreadPool& pool);
+
+// out[r] = a[r][0] * b[r][0] + a[r][1] * b[r][1] + ... for every row, in the
+// same chunks; inside a chunk the products go through the SIMD dot kernel
+void dotRows(const double* a, const double* b, size_t rows, size_t cols, double* out, ThreadPool& pool);
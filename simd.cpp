@@ -0,0 +1,72 @@
+#include "simd.hpp"
+#include "kernels.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+namespace {
+
+SimdKernels portableKernels() {
+    return {
+        "portable",
+        binaryKernel<AddOp>,
+        binaryKernel<SubOp>,
+        binaryKernel<MulOp>,
+        binaryKernel<DivOp>,
+        unaryKernel<SqrtOp>,
+        unaryKernel<AbsOp>,
+        fmaKernel,
+        dotKernel,
+        {gemmMicroKernel, gemmMicroRows, gemmMicroCols},
+    };
+}
+
+bool cpuSupports(const char* isa) {
+#if defined(SICLANG_SIMD_X86)
+    __builtin_cpu_init();
+    if (std::strcmp(isa, "avx512") == 0) return __builtin_cpu_supports("avx512f");
+    if (std::strcmp(isa, "avx2") == 0) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(SICLANG_SIMD_NEON)
+    if (std::strcmp(isa, "neon") == 0) return true;
+#endif
+    return std::strcmp(isa, "portable") == 0;
+}
+
+SimdKernels kernelsFor(const char* isa) {
+#if defined(SICLANG_SIMD_X86)
+    if (std::strcmp(isa, "avx512") == 0) return avx512Kernels();
+    if (std::strcmp(isa, "avx2") == 0) return avx2Kernels();
+#elif defined(SICLANG_SIMD_NEON)
+    if (std::strcmp(isa, "neon") == 0) return neonKernels();
+#endif
+    return portableKernels();
+}
+
+SimdKernels selectKernels() {
+    const char* forced = std::getenv("SICLANG_SIMD");
+    if (forced && cpuSupports(forced)) {
+        return kernelsFor(forced);
+    }
+    for (const char* isa : {"avx512", "avx2", "neon"}) {
+        if (cpuSupports(isa)) {
+            return kernelsFor(isa);
+        }
+    }
+    return portableKernels();
+}
+
+} // namespace
+
+const SimdKernels& simdKernels() {
+    static const SimdKernels kernels = selectKernels();
+    return kernels;
+}
+
+std::vector<SimdKernels> supportedKernels() {
+    std::vector<SimdKernels> all;
+    for (const char* isa : {"avx512", "avx2", "neon"}) {
+        if (cpuSupports(isa)) all.push_back(kernelsFor(isa));
+    }
+    all.push_back(portableKernels());
+    return all;
+}
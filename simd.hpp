@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Hand-written SIMD kernels for the dense arithmetic builtins. A single binary
+// carries every variant its target architecture can run; simdKernels() picks
+// the widest one the host CPU supports the first time it is called. Setting
+// SICLANG_SIMD=portable|avx2|avx512|neon forces a variant (if supported).
+
+using BinaryKernelFn = void (*)(const double* a, bool aScalar, const double* b, bool bScalar, double* out, size_t n);
+using UnaryKernelFn = void (*)(const double* in, double* out, size_t n);
+
+// out[i] = a[i] * b[i] + c[i], rounded once. Scalar operands are broadcast as
+// for BinaryKernelFn, and `out` may be any of the operands' buffers.
+using FmaKernelFn = void (*)(const double* a, bool aScalar, const double* b, bool bScalar, const double* c,
+                             bool cScalar, double* out, size_t n);
+
+// Sum of a[i] * b[i] over n contiguous elements
+using DotKernelFn = double (*)(const double* a, const double* b, size_t n);
+
+// GEMM micro-kernel: c[rows x cols] (row stride ldc) += a * b over kc steps,
+// where a is a packed panel holding `rows` values per step and b holds `cols`
+using GemmMicroKernelFn = void (*)(size_t kc, const double* a, const double* b, double* c, size_t ldc);
+
+struct GemmKernel {
+    GemmMicroKernelFn micro;
+    size_t rows;
+    size_t cols;
+};
+
+struct SimdKernels {
+    const char* name;
+    BinaryKernelFn add;
+    BinaryKernelFn sub;
+    BinaryKernelFn mul;
+    BinaryKernelFn div;
+    UnaryKernelFn sqrt;
+    UnaryKernelFn abs;
+    FmaKernelFn fma;
+    DotKernelFn dot;
+    GemmKernel gemm;
+};
+
+const SimdKernels& simdKernels();
+
+// Every variant the host can run, widest first; the last is always portable
+std::vector<SimdKernels> supportedKernels();
+
+// Per-ISA tables, each defined in its own simd_*.cpp built with matching flags
+SimdKernels avx2Kernels();
+SimdKernels avx512Kernels();
+SimdKernels neonKernels();
@@ -0,0 +1,26 @@
+// Built with -mavx2 -mfma; only reached after simdKernels() has checked the CPU
+#include "simd_impl.hpp"
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2 {
+    using Reg = __m256d;
+    static constexpr size_t width = 4;
+    static Reg load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, Reg r) { _mm256_storeu_pd(p, r); }
+    static Reg set1(double x) { return _mm256_set1_pd(x); }
+    static Reg add(Reg x, Reg y) { return _mm256_add_pd(x, y); }
+    static Reg sub(Reg x, Reg y) { return _mm256_sub_pd(x, y); }
+    static Reg mul(Reg x, Reg y) { return _mm256_mul_pd(x, y); }
+    static Reg div(Reg x, Reg y) { return _mm256_div_pd(x, y); }
+    static Reg sqrt(Reg x) { return _mm256_sqrt_pd(x); }
+    static Reg abs(Reg x) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x); }
+    static Reg fmadd(Reg x, Reg y, Reg acc) { return _mm256_fmadd_pd(x, y, acc); }
+};
+
+} // namespace
+
+SimdKernels avx2Kernels() {
+    return makeKernels<Avx2, 6, 2>("avx2");
+}
@@ -0,0 +1,29 @@
+// Built with -mavx512f; only reached after simdKernels() has checked the CPU
+#include "simd_impl.hpp"
+#include <immintrin.h>
+
+namespace {
+
+struct Avx512 {
+    using Reg = __m512d;
+    static constexpr size_t width = 8;
+    static Reg load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, Reg r) { _mm512_storeu_pd(p, r); }
+    static Reg set1(double x) { return _mm512_set1_pd(x); }
+    static Reg add(Reg x, Reg y) { return _mm512_add_pd(x, y); }
+    static Reg sub(Reg x, Reg y) { return _mm512_sub_pd(x, y); }
+    static Reg mul(Reg x, Reg y) { return _mm512_mul_pd(x, y); }
+    static Reg div(Reg x, Reg y) { return _mm512_div_pd(x, y); }
+    // The zero-masked form sidesteps a spurious -Wmaybe-uninitialized in GCC 12
+    static Reg sqrt(Reg x) { return _mm512_maskz_sqrt_pd(0xFF, x); }
+    static Reg abs(Reg x) {
+        return _mm512_castsi512_pd(_mm512_and_epi64(_mm512_castpd_si512(x), _mm512_set1_epi64(0x7fffffffffffffffLL)));
+    }
+    static Reg fmadd(Reg x, Reg y, Reg acc) { return _mm512_fmadd_pd(x, y, acc); }
+};
+
+} // namespace
+
+SimdKernels avx512Kernels() {
+    return makeKernels<Avx512, 8, 3>("avx512");
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+// Loop skeletons shared by the simd_*.cpp files. Include this only from those
+// files: everything sits in an anonymous namespace, so each file compiles its
+// own copy for its instruction set and none of it can be merged by the linker
+// into code that runs on a CPU without that instruction set.
+//
+// An ISA description V provides Reg, width, load, store, set1, and the
+// add/sub/mul/div/sqrt/abs/fmadd operations on Reg.
+
+#include "simd.hpp"
+
+namespace {
+
+struct AddV {
+    template <typename V> static typename V::Reg apply(typename V::Reg x, typename V::Reg y) { return V::add(x, y); }
+    static double scalar(double x, double y) { return x + y; }
+};
+
+struct SubV {
+    template <typename V> static typename V::Reg apply(typename V::Reg x, typename V::Reg y) { return V::sub(x, y); }
+    static double scalar(double x, double y) { return x - y; }
+};
+
+struct MulV {
+    template <typename V> static typename V::Reg apply(typename V::Reg x, typename V::Reg y) { return V::mul(x, y); }
+    static double scalar(double x, double y) { return x * y; }
+};
+
+struct DivV {
+    template <typename V> static typename V::Reg apply(typename V::Reg x, typename V::Reg y) { return V::div(x, y); }
+    static double scalar(double x, double y) { return x / y; }
+};
+
+struct SqrtV {
+    template <typename V> static typename V::Reg apply(typename V::Reg x) { return V::sqrt(x); }
+    static double scalar(double x) { return __builtin_sqrt(x); }
+};
+
+struct AbsV {
+    template <typename V> static typename V::Reg apply(typename V::Reg x) { return V::abs(x); }
+    static double scalar(double x) { return __builtin_fabs(x); }
+};
+
+// Operand sources: a streamed buffer or one broadcast scalar
+template <typename V>
+struct Stream {
+    const double* p;
+    typename V::Reg load(size_t i) const { return V::load(p + i); }
+    double at(size_t i) const { return p[i]; }
+};
+
+template <typename V>
+struct Splat {
+    typename V::Reg reg;
+    double value;
+    explicit Splat(double x) : reg(V::set1(x)), value(x) {}
+    typename V::Reg load(size_t) const { return reg; }
+    double at(size_t) const { return value; }
+};
+
+// Four registers per iteration to hide latency, then single registers, then a
+// scalar tail. Every block is loaded before it is stored, so `out` may be `a`
+// or `b`.
+template <typename V, typename Op, typename A, typename B>
+void binaryBody(const A& a, const B& b, double* out, size_t n) {
+    constexpr size_t w = V::width;
+    size_t i = 0;
+    for (; i + 4 * w <= n; i += 4 * w) {
+        typename V::Reg r0 = Op::template apply<V>(a.load(i), b.load(i));
+        typename V::Reg r1 = Op::template apply<V>(a.load(i + w), b.load(i + w));
+        typename V::Reg r2 = Op::template apply<V>(a.load(i + 2 * w), b.load(i + 2 * w));
+        typename V::Reg r3 = Op::template apply<V>(a.load(i + 3 * w), b.load(i + 3 * w));
+        V::store(out + i, r0);
+        V::store(out + i + w, r1);
+        V::store(out + i + 2 * w, r2);
+        V::store(out + i + 3 * w, r3);
+    }
+    for (; i + w <= n; i += w) {
+        V::store(out + i, Op::template apply<V>(a.load(i), b.load(i)));
+    }
+    for (; i < n; ++i) {
+        out[i] = Op::scalar(a.at(i), b.at(i));
+    }
+}
+
+template <typename V, typename Op>
+void binaryLoop(const double* a, bool aScalar, const double* b, bool bScalar, double* out, size_t n) {
+    if (aScalar && bScalar) {
+        binaryBody<V, Op>(Splat<V>(a[0]), Splat<V>(b[0]), out, n);
+    }
+    else if (aScalar) {
+        binaryBody<V, Op>(Splat<V>(a[0]), Stream<V>{b}, out, n);
+    }
+    else if (bScalar) {
+        binaryBody<V, Op>(Stream<V>{a}, Splat<V>(b[0]), out, n);
+    }
+    else {
+        binaryBody<V, Op>(Stream<V>{a}, Stream<V>{b}, out, n);
+    }
+}
+
+template <typename V, typename Op>
+void unaryLoop(const double* in, double* out, size_t n) {
+    constexpr size_t w = V::width;
+    size_t i = 0;
+    for (; i + 4 * w <= n; i += 4 * w) {
+        typename V::Reg r0 = Op::template apply<V>(V::load(in + i));
+        typename V::Reg r1 = Op::template apply<V>(V::load(in + i + w));
+        typename V::Reg r2 = Op::template apply<V>(V::load(in + i + 2 * w));
+        typename V::Reg r3 = Op::template apply<V>(V::load(in + i + 3 * w));
+        V::store(out + i, r0);
+        V::store(out + i + w, r1);
+        V::store(out + i + 2 * w, r2);
+        V::store(out + i + 3 * w, r3);
+    }
+    for (; i + w <= n; i += w) {
+        V::store(out + i, Op::template apply<V>(V::load(in + i)));
+    }
+    for (; i < n; ++i) {
+        out[i] = Op::scalar(in[i]);
+    }
+}
+
+template <typename V, typename A, typename B, typename C>
+void fmaBody(const A& a, const B& b, const C& c, double* out, size_t n) {
+    constexpr size_t w = V::width;
+    size_t i = 0;
+    for (; i + 4 * w <= n; i += 4 * w) {
+        typename V::Reg r0 = V::fmadd(a.load(i), b.load(i), c.load(i));
+        typename V::Reg r1 = V::fmadd(a.load(i + w), b.load(i + w), c.load(i + w));
+        typename V::Reg r2 = V::fmadd(a.load(i + 2 * w), b.load(i + 2 * w), c.load(i + 2 * w));
+        typename V::Reg r3 = V::fmadd(a.load(i + 3 * w), b.load(i + 3 * w), c.load(i + 3 * w));
+        V::store(out + i, r0);
+        V::store(out + i + w, r1);
+        V::store(out + i + 2 * w, r2);
+        V::store(out + i + 3 * w, r3);
+    }
+    for (; i + w <= n; i += w) {
+        V::store(out + i, V::fmadd(a.load(i), b.load(i), c.load(i)));
+    }
+    for (; i < n; ++i) {
+        out[i] = __builtin_fma(a.at(i), b.at(i), c.at(i));
+    }
+}
+
+// Picks a Stream or a Splat for each operand in turn, then runs the body
+template <typename V, typename... Sources>
+void fmaSelect(const double* const* operands, const bool* scalar, double* out, size_t n, const Sources&... sources) {
+    constexpr size_t i = sizeof...(Sources);
+    if constexpr (i == 3) {
+        fmaBody<V>(sources..., out, n);
+    }
+    else if (scalar[i]) {
+        fmaSelect<V>(operands, scalar, out, n, sources..., Splat<V>(operands[i][0]));
+    }
+    else {
+        fmaSelect<V>(operands, scalar, out, n, sources..., Stream<V>{operands[i]});
+    }
+}
+
+template <typename V>
+void fmaLoop(const double* a, bool aScalar, const double* b, bool bScalar, const double* c, bool cScalar,
+             double* out, size_t n) {
+    const double* operands[] = {a, b, c};
+    const bool scalar[] = {aScalar, bScalar, cScalar};
+    fmaSelect<V>(operands, scalar, out, n);
+}
+
+// Four accumulators, added together lane by lane and then across the lanes
+template <typename V>
+double dotLoop(const double* a, const double* b, size_t n) {
+    constexpr size_t w = V::width;
+    typename V::Reg acc0 = V::set1(0.0), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    size_t i = 0;
+    for (; i + 4 * w <= n; i += 4 * w) {
+        acc0 = V::fmadd(V::load(a + i), V::load(b + i), acc0);
+        acc1 = V::fmadd(V::load(a + i + w), V::load(b + i + w), acc1);
+        acc2 = V::fmadd(V::load(a + i + 2 * w), V::load(b + i + 2 * w), acc2);
+        acc3 = V::fmadd(V::load(a + i + 3 * w), V::load(b + i + 3 * w), acc3);
+    }
+    for (; i + w <= n; i += w) {
+        acc0 = V::fmadd(V::load(a + i), V::load(b + i), acc0);
+    }
+    double lanes[w];
+    V::store(lanes, V::add(V::add(acc0, acc1), V::add(acc2, acc3)));
+    double sum = 0.0;
+    for (size_t j = 0; j < w; ++j) sum += lanes[j];
+    for (; i < n; ++i) {
+        sum = __builtin_fma(a[i], b[i], sum);
+    }
+    return sum;
+}
+
+// MR x (NV * width) register tile; the accumulators start from C so repeated
+// calls over successive k blocks keep summing into the same tile
+template <typename V, size_t MR, size_t NV>
+void gemmMicro(size_t kc, const double* a, const double* b, double* c, size_t ldc) {
+    constexpr size_t w = V::width;
+    typename V::Reg acc[MR][NV];
+#pragma GCC unroll 16
+    for (size_t r = 0; r < MR; ++r) {
+#pragma GCC unroll 4
+        for (size_t v = 0; v < NV; ++v) acc[r][v] = V::load(c + r * ldc + v * w);
+    }
+    for (size_t p = 0; p < kc; ++p) {
+        typename V::Reg bv[NV];
+#pragma GCC unroll 4
+        for (size_t v = 0; v < NV; ++v) bv[v] = V::load(b + v * w);
+#pragma GCC unroll 16
+        for (size_t r = 0; r < MR; ++r) {
+            typename V::Reg ar = V::set1(a[r]);
+#pragma GCC unroll 4
+            for (size_t v = 0; v < NV; ++v) acc[r][v] = V::fmadd(ar, bv[v], acc[r][v]);
+        }
+        a += MR;
+        b += NV * w;
+    }
+#pragma GCC unroll 16
+    for (size_t r = 0; r < MR; ++r) {
+#pragma GCC unroll 4
+        for (size_t v = 0; v < NV; ++v) V::store(c + r * ldc + v * w, acc[r][v]);
+    }
+}
+
+template <typename V, size_t MR, size_t NV>
+SimdKernels makeKernels(const char* name) {
+    return {
+        name,
+        binaryLoop<V, AddV>,
+        binaryLoop<V, SubV>,
+        binaryLoop<V, MulV>,
+        binaryLoop<V, DivV>,
+        unaryLoop<V, SqrtV>,
+        unaryLoop<V, AbsV>,
+        fmaLoop<V>,
+        dotLoop<V>,
+        {gemmMicro<V, MR, NV>, MR, NV * V::width},
+    };
+}
+
+} // namespace
@@ -0,0 +1,26 @@
+// AArch64 only: Advanced SIMD is part of the base architecture there
+#include "simd_impl.hpp"
+#include <arm_neon.h>
+
+namespace {
+
+struct Neon {
+    using Reg = float64x2_t;
+    static constexpr size_t width = 2;
+    static Reg load(const double* p) { return vld1q_f64(p); }
+    static void store(double* p, Reg r) { vst1q_f64(p, r); }
+    static Reg set1(double x) { return vdupq_n_f64(x); }
+    static Reg add(Reg x, Reg y) { return vaddq_f64(x, y); }
+    static Reg sub(Reg x, Reg y) { return vsubq_f64(x, y); }
+    static Reg mul(Reg x, Reg y) { return vmulq_f64(x, y); }
+    static Reg div(Reg x, Reg y) { return vdivq_f64(x, y); }
+    static Reg sqrt(Reg x) { return vsqrtq_f64(x); }
+    static Reg abs(Reg x) { return vabsq_f64(x); }
+    static Reg fmadd(Reg x, Reg y, Reg acc) { return vfmaq_f64(acc, x, y); }
+};
+
+} // namespace
+
+SimdKernels neonKernels() {
+    return makeKernels<Neon, 6, 4>("neon");
+}
@@ -0,0 +1,85 @@
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+ThreadPool::ThreadPool(size_t threads) {
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::defaultThreadCount() {
+    if (const char* env = std::getenv("SICLANG_THREADS")) {
+        long n = std::strtol(env, nullptr, 10);
+        if (n > 0) return static_cast<size_t>(n);
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Claims and runs the next unclaimed index of `job`; false once none are left
+bool ThreadPool::runOne(Job& job) {
+    size_t i = job.next.fetch_add(1);
+    if (i >= job.count) return false;
+    (*job.task)(i);
+    if (job.done.fetch_add(1) + 1 == job.count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+    if (workers.empty() || count <= 1) {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    Job job;
+    job.count = count;
+    job.task = &task;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(&job);
+    }
+    wake.notify_all();
+
+    while (runOne(job)) {}
+
+    // Every index is claimed; wait for the workers still running ours to leave
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = std::find(jobs.begin(), jobs.end(), &job);
+    if (it != jobs.end()) jobs.erase(it);
+    finished.wait(lock, [&] { return job.done.load() == count && job.activeWorkers == 0; });
+}
+
+void ThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || !jobs.empty(); });
+        if (stopping) return;
+
+        Job* job = jobs.front();
+        if (job->next.load() >= job->count) {
+            jobs.pop_front();
+            continue;
+        }
+        job->activeWorkers++;
+        lock.unlock();
+        while (runOne(*job)) {}
+        lock.lock();
+        if (--job->activeWorkers == 0) {
+            finished.notify_all();
+        }
+    }
+}
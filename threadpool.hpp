@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that share parallelFor ranges. The calling
+// thread always works on its own range too, so a parallelFor issued from inside
+// a task, or from several threads at once, cannot deadlock.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = defaultThreadCount());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Runs task(i) for every i in [0, count) and returns once all have finished
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+    // Threads that take part in a parallelFor, the caller included
+    size_t size() const { return workers.size() + 1; }
+
+    // SICLANG_THREADS if set, otherwise the number of hardware threads
+    static size_t defaultThreadCount();
+
+private:
+    struct Job {
+        size_t count = 0;
+        const std::function<void(size_t)>* task = nullptr;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        size_t activeWorkers = 0;  // guarded by mutex
+    };
+
+    bool runOne(Job& job);
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<Job*> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    bool stopping = false;
+};
+
+// Queue of at most `capacity` items between a producing and a consuming
+// thread: push waits while it is full, so the producer cannot run arbitrarily
+// far ahead, and pop waits while it is empty.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [&] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+    }
+
+    // Ends the queue once the items already in it have been taken
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_one();
+    }
+
+    // Takes the oldest item; false once the queue is closed and empty
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [&] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+private:
+    size_t capacity;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    bool closed = false;
+};
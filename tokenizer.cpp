@@ -0,0 +1,84 @@
+#include "tokenizer.hpp"
+#include <cwctype>
+
+bool StreamTokenizer::feed(std::wstring_view chunk, bool last, TokenList& out) {
+    bool fromPartial = open;
+    start = 0;
+
+    bool atLineStart = lineStart;
+    auto extend = [&](size_t i) {
+        if (!open) {
+            open = true;
+            openAtLineStart = atLineStart;
+            start = i;
+        }
+    };
+    // Ends the open token before position `end`; false if it was an exit line
+    auto close = [&](size_t end, bool atLineEnd) {
+        if (!open) return true;
+        open = false;
+        std::wstring_view token;
+        if (fromPartial) {
+            spanning = std::move(partial);
+            spanning.append(chunk.substr(0, end));
+            partial.clear();
+            fromPartial = false;
+            token = spanning;
+        }
+        else {
+            token = chunk.substr(start, end - start);
+        }
+        if (stopAtExit && atLineEnd && openAtLineStart && token == L"exit") return false;
+        out.push_back(token);
+        return true;
+    };
+
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        wchar_t c = chunk[i];
+        wchar_t before = previous;
+        previous = c;
+        atLineStart = lineStart;
+        lineStart = false;
+
+        if (c == L'"' && before != L'\\') {
+            inQuotes = !inQuotes;
+            extend(i);
+            continue;
+        }
+        if (inQuotes) {
+            extend(i);
+            continue;
+        }
+        if (c == L'[') {
+            bracketDepth++;
+            extend(i);
+            continue;
+        }
+        if (c == L']') {
+            bracketDepth--;
+            extend(i);
+            if (bracketDepth == 0 && !close(i + 1, false)) return false;
+            continue;
+        }
+        if (std::iswspace(c) && bracketDepth == 0) {
+            bool lineEnd = c == L'\n' || c == L'\r';
+            if (!close(i, lineEnd)) return false;
+            lineStart = lineEnd;
+            continue;
+        }
+        extend(i);
+    }
+
+    if (last) {
+        return close(chunk.size(), true);
+    }
+    if (open) {
+        if (fromPartial) {
+            partial.append(chunk);
+        }
+        else {
+            partial.assign(chunk.substr(start));
+        }
+    }
+    return true;
+}
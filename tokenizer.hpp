@@ -0,0 +1,38 @@
+#pragma once
+
+#include "types.hpp"
+#include <memory_resource>
+#include <string_view>
+
+// Tokens of the text being processed: views into it, normally kept in the
+// interpreter's line arena
+using TokenList = std::pmr::vector<std::wstring_view>;
+
+// Splits source text into tokens. Whitespace separates tokens except inside
+// brackets and double quotes; a top-level `]` also ends one. The text may arrive
+// in pieces of any size: quote and bracket state carry over from one piece to
+// the next, so a literal can span pieces and lines.
+class StreamTokenizer {
+public:
+    // With stopAtExit, a line that is exactly `exit` ends the input, the way
+    // it ends a REPL session
+    explicit StreamTokenizer(bool stopAtExit = false) : stopAtExit(stopAtExit) {}
+
+    // Appends the tokens that `chunk` completes to `out`; `last` marks the end
+    // of the input. Tokens are views into `chunk` or, for one that began in an
+    // earlier piece, into the tokenizer, and stay valid until the next call.
+    // Returns false once an exit line is reached; nothing after it is read.
+    bool feed(std::wstring_view chunk, bool last, TokenList& out);
+
+private:
+    bool stopAtExit;
+    bool inQuotes = false;
+    int bracketDepth = 0;
+    wchar_t previous = 0;   // last character seen, for escaped quotes
+    bool lineStart = true;  // nothing but the line break precedes the current position
+    bool open = false;       // a token is in progress
+    bool openAtLineStart = false;
+    size_t start = 0;        // where the open token starts in the current chunk
+    String partial;          // start of a token that began in an earlier chunk
+    String spanning;         // text of the last such token once complete
+};
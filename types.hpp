@@ -1,12 +1,20 @@
 #pragma once
 
 #include <vector>
-#include <stack>
 #include <unordered_map>
 #include <map>
+#include <deque>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <functional>
+#include <memory>
+#include <memory_resource>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include <utility>
+#include <iterator>
 
 // Forward declaration of Array
 struct Array;
@@ -18,11 +26,515 @@ using Element = std::variant<wchar_t, double, String, Array>;
 // Array type: a vector of elements
 struct Array : std::vector<Element> {};
 
-// Stack of arrays
-using Stack = std::stack<Array>;
+// Where Buffers on this thread allocate their elements; null means the
+// ordinary heap. An interpreter points it at its memory meter while it runs
+// code with :mem on, so the meter sees that interpreter's arrays and no
+// other thread's.
+inline thread_local std::pmr::memory_resource* arrayMemory = nullptr;
 
-// Function dictionary: maps function name to its body (sequence of tokens)
-using FunctionDict = std::map<String, std::vector<String>>;
+// Contiguous doubles behind an NDArray: either a vector the Buffer owns or
+// memory that something else keeps alive, such as a file mapping (see
+// arrayfile.hpp). Borrowed memory must be writable. Copies share the memory,
+// so copying a Buffer takes constant time. Copy-on-write keeps copies apart:
+// non-const access first gives a Buffer its own vector while another still
+// shares the memory. Anything that changes the length copies borrowed memory
+// into a vector first.
+class Buffer {
+public:
+    Buffer() = default;
+    Buffer(std::pmr::vector<double> values) { adopt(std::move(values)); }
+    Buffer(std::shared_ptr<void> keepAlive, double* first, size_t count)
+        : memory(std::move(keepAlive)), first(first), count(count) {}
+
+    Buffer(const Buffer& other) = default;
+    Buffer& operator=(const Buffer& other) = default;
+    Buffer(Buffer&& other) noexcept { *this = std::move(other); }
+    Buffer& operator=(Buffer&& other) noexcept {
+        memory = std::move(other.memory);
+        owned = std::exchange(other.owned, nullptr);
+        first = std::exchange(other.first, nullptr);
+        count = std::exchange(other.count, 0);
+        return *this;
+    }
+
+    double* data() { unshare(); return first; }
+    const double* data() const { return first; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    double& operator[](size_t i) { unshare(); return first[i]; }
+    const double& operator[](size_t i) const { return first[i]; }
+    double* begin() { unshare(); return first; }
+    double* end() { unshare(); return first + count; }
+    const double* begin() const { return first; }
+    const double* end() const { return first + count; }
+
+    // True while the data is borrowed rather than owned
+    bool borrowed() const { return memory && !owned; }
+
+    // True while another Buffer shares the memory
+    bool shared() const { return memory.use_count() > 1; }
+
+    // The memory this Buffer keeps alive and its size, for memory accounting.
+    // Buffers sharing memory report the same storage.
+    const void* storage() const { return memory.get(); }
+    size_t storageBytes() const { return (owned ? owned->capacity() : count) * sizeof(double); }
+
+    // Allocator for a vector to build a Buffer from, following arrayMemory
+    static std::pmr::polymorphic_allocator<double> allocator() {
+        return arrayMemory ? arrayMemory : std::pmr::new_delete_resource();
+    }
+
+    // `n` elements from `offset` on, sharing this Buffer's memory
+    Buffer slice(size_t offset, size_t n) const {
+        Buffer part = *this;
+        part.first += offset;
+        part.count = n;
+        return part;
+    }
+
+    void resize(size_t n) {
+        own().resize(n);
+        sync();
+    }
+    void append(const double* from, const double* to) {
+        own().insert(owned->end(), from, to);
+        sync();
+    }
+
+private:
+    void unshare() {
+        if (shared()) adopt(std::pmr::vector<double>(first, first + count, allocator()));
+    }
+    // The owned vector, private and holding exactly this Buffer's elements
+    std::pmr::vector<double>& own() {
+        if (!owned || shared() || first != owned->data() || count != owned->size()) {
+            adopt(std::pmr::vector<double>(first, first + count, allocator()));
+        }
+        return *owned;
+    }
+    void adopt(std::pmr::vector<double> values) {
+        auto vector = std::make_shared<std::pmr::vector<double>>(std::move(values));
+        owned = vector.get();
+        memory = std::move(vector);
+        sync();
+    }
+    void sync() {
+        first = owned->data();
+        count = owned->size();
+    }
+
+    std::shared_ptr<void> memory;         // keeps the elements alive
+    std::pmr::vector<double>* owned = nullptr;  // the vector in memory, unless borrowed
+    double* first = nullptr;
+    size_t count = 0;
+};
+
+// Dense numeric array: a buffer of doubles plus shape and strides. Strides are
+// counted in elements from the start of the buffer. Freshly built arrays are
+// row-major; strided views (see view.hpp) may step over elements or reorder
+// axes, and their buffer spans just the elements they can reach.
+struct NDArray {
+    Buffer data;
+    std::vector<size_t> shape;
+    std::vector<size_t> strides;
+
+    NDArray() = default;
+    explicit NDArray(const std::vector<size_t>& dims) {
+        reshape(dims);
+        data.resize(shape.empty() ? 0 : shape[0] * strides[0]);
+    }
+
+    // Number of elements, which a view may have fewer of than its buffer
+    size_t size() const {
+        if (shape.empty()) return 0;
+        size_t count = 1;
+        for (size_t dim : shape) count *= dim;
+        return count;
+    }
+    size_t rank() const { return shape.size(); }
+
+    // True when the buffer holds exactly the elements, in row-major order
+    bool contiguous() const {
+        size_t expected = 1;
+        for (size_t i = shape.size(); i-- > 0;) {
+            if (shape[i] != 1 && strides[i] != expected) return false;
+            expected *= shape[i];
+        }
+        return data.size() == size();
+    }
+
+    // Replace the shape and recompute row-major strides; the data is untouched
+    void reshape(const std::vector<size_t>& dims) {
+        shape = dims;
+        strides.assign(dims.size(), 1);
+        for (size_t i = dims.size(); i-- > 1;) {
+            strides[i - 1] = strides[i] * dims[i];
+        }
+    }
+};
+
+// Packed rank-1 array of characters or of strings. Every element's characters
+// sit end to end in one buffer, held inside the Text itself while short, so a
+// whole array costs at most one allocation and appending another is a single
+// copy. Strings are handed out as views into that buffer.
+class Text {
+public:
+    explicit Text(bool characters) : chars(characters) {}
+
+    Text(const Text& other) : chars(other.chars), count(other.count), ends(other.ends) {
+        append(other.data(), other.length);
+    }
+    Text(Text&& other) noexcept { *this = std::move(other); }
+    Text& operator=(const Text& other) { return *this = Text(other); }
+    Text& operator=(Text&& other) noexcept {
+        chars = other.chars;
+        count = std::exchange(other.count, 0);
+        ends = std::move(other.ends);
+        length = std::exchange(other.length, 0);
+        heapCapacity = std::exchange(other.heapCapacity, 0);
+        heap = std::move(other.heap);
+        if (!heap) std::copy(other.local, other.local + length, local);
+        return *this;
+    }
+
+    // True for an array of characters, false for an array of strings
+    bool characters() const { return chars; }
+    size_t size() const { return count; }
+
+    // Element i: one character of a character array, or a whole string
+    std::wstring_view operator[](size_t i) const {
+        if (chars) return {data() + i, 1};
+        size_t first = i == 0 ? 0 : ends[i - 1];
+        return {data() + first, (i + 1 == count ? length : ends[i]) - first};
+    }
+
+    void push(wchar_t c) {
+        append(&c, 1);
+        ++count;
+    }
+    void push(std::wstring_view text) {
+        if (count > 0) ends.push_back(length);
+        append(text.data(), text.size());
+        ++count;
+    }
+    // Heap bytes held beyond the Text itself
+    size_t heapBytes() const { return heapCapacity * sizeof(wchar_t) + ends.capacity() * sizeof(size_t); }
+
+    // Appends the elements of `other`, which must be the same kind
+    void append(const Text& other) {
+        if (!chars && count > 0 && other.count > 0) ends.push_back(length);
+        size_t shift = length;
+        for (size_t end : other.ends) ends.push_back(end + shift);
+        append(other.data(), other.length);
+        count += other.count;
+    }
+
+private:
+    // Sized so a Text takes no more room than an NDArray in a Value's payload
+    static constexpr size_t localCapacity = 10;
+
+    const wchar_t* data() const { return heap ? heap.get() : local; }
+
+    void append(const wchar_t* from, size_t n) {
+        size_t capacity = heap ? heapCapacity : localCapacity;
+        if (length + n > capacity) {
+            size_t grown = std::max(length + n, capacity * 2);
+            std::unique_ptr<wchar_t[]> bigger(new wchar_t[grown]);
+            std::copy(data(), data() + length, bigger.get());
+            heap = std::move(bigger);
+            heapCapacity = grown;
+        }
+        std::copy(from, from + n, (heap ? heap.get() : local) + length);
+        length += n;
+    }
+
+    bool chars = false;
+    size_t count = 0;           // elements
+    std::vector<size_t> ends;   // strings only: where each element but the last ends
+    size_t length = 0;          // characters in the buffer
+    size_t heapCapacity = 0;
+    std::unique_ptr<wchar_t[]> heap;  // the buffer once it outgrows local
+    wchar_t local[localCapacity];
+};
+
+// Deferred chain of elementwise operations (see fusion.hpp)
+struct LazyExpr;
+NDArray evaluateLazy(const LazyExpr& expr);
+
+// Stack value: a reference-counted, copy-on-write handle to a nested Array, a
+// dense NDArray or packed Text. Copies share one payload; mutate() detaches a
+// private copy first if anyone else still holds it. A lazy value counts as an
+// NDArray and is computed in place, for every handle sharing it, the first
+// time it is read.
+// A single number is held inline with no payload at all. It counts as a
+// one-element NDArray, built the first time something asks for the array.
+class Value {
+public:
+    Value(double number) : immediate(number) {}
+    Value(Array arr) : data(std::make_shared<Payload>(std::move(arr))) {}
+    Value(NDArray arr) {
+        if (arr.rank() == 1 && arr.size() == 1) {
+            immediate = arr.data[0];
+        }
+        else {
+            data = std::make_shared<Payload>(std::move(arr));
+        }
+    }
+    Value(Text text) : data(std::make_shared<Payload>(std::move(text))) {}
+    Value(std::shared_ptr<const LazyExpr> expr) : data(std::make_shared<Payload>(std::move(expr))) {}
+
+    template <typename T> bool holds() const {
+        if constexpr (std::is_same_v<T, NDArray>) {
+            if (scalar() || lazy()) return true;
+        }
+        return data && std::holds_alternative<T>(*data);
+    }
+    template <typename T> const T& get() const {
+        force();
+        return std::get<T>(*data);
+    }
+    template <typename T> T& mutate() {
+        force();
+        if (data.use_count() > 1) {
+            data = std::make_shared<Payload>(*data);
+        }
+        return std::get<T>(*data);
+    }
+
+    // True when this handle is the only reference, so mutate() will not copy
+    bool unique() const { return !data || data.use_count() == 1; }
+
+    bool lazy() const { return data && std::holds_alternative<LazyPtr>(*data); }
+    const LazyExpr& expr() const { return *std::get<LazyPtr>(*data); }
+
+    // True while the value is an inline number, readable through number()
+    bool scalar() const { return !data; }
+    double number() const { return immediate; }
+
+    // The payload's address and size, for memory accounting; handles sharing
+    // a payload report the same one. Null and 0 for an inline number.
+    const void* payload() const { return data.get(); }
+    size_t payloadBytes() const;
+
+private:
+    using LazyPtr = std::shared_ptr<const LazyExpr>;
+    using Payload = std::variant<Array, NDArray, Text, LazyPtr>;
+
+    void force() const {
+        if (!data) {
+            NDArray arr({1});
+            arr.data[0] = immediate;
+            data = std::make_shared<Payload>(std::move(arr));
+        }
+        else if (const LazyPtr* expr = std::get_if<LazyPtr>(data.get())) {
+            *data = evaluateLazy(**expr);
+        }
+    }
+
+    mutable std::shared_ptr<Payload> data;  // null for an inline number
+    double immediate = 0;
+};
+
+inline size_t Value::payloadBytes() const { return data ? sizeof(Payload) : 0; }
+
+// Stack of values, kept in a vector so it can be walked without popping
+struct Stack : std::vector<Value> {
+    Value& top() { return back(); }
+    const Value& top() const { return back(); }
+    void push(Value value) { push_back(std::move(value)); }
+    void pop() { pop_back(); }
+
+    // Pop the top value and hand it to the caller without copying
+    Value take() {
+        Value value = std::move(back());
+        pop_back();
+        return value;
+    }
+};
 
 // Built-in function type
-using BuiltInFunc = std::function<void(Stack&)>; 
\ No newline at end of file
+using BuiltInFunc = std::function<void(Stack&)>;
+
+// Bytecode operations produced by Interpreter::compile
+enum class OpCode : uint8_t {
+    PushConst,          // push constants[arg]
+    CallBuiltin,        // run builtin number arg, named by symbol alt
+    CallWordOrBuiltin,  // run symbol arg's word if defined, else its builtin
+    CallWordOrPush,     // run symbol arg's word if defined, else push constants[alt]
+    DefineWord,         // bind symbol arg's word to bodies[alt]
+    DumpStack,          // print the whole stack
+    SetLazy,            // turn lazy elementwise fusion on (arg 1) or off (arg 0)
+    SetSummary,         // turn abbreviated printing of big arrays on (arg 1) or off (arg 0)
+    Profile,            // profiler command arg; folded output goes to the file messages[alt]
+    SaveImage,          // write an image of the session to the file messages[arg]
+    ReportError,        // print messages[arg] to stderr
+    Memory              // memory meter command arg; JSON goes to the file messages[alt]
+};
+
+struct Instruction {
+    OpCode op;
+    uint32_t arg;
+    uint32_t alt;
+};
+
+// Compiled token sequence: instructions plus the pools they index into
+struct Code {
+    std::vector<Instruction> instructions;
+    std::vector<Value> constants;
+    std::vector<std::shared_ptr<const Code>> bodies;
+    std::vector<String> messages;
+};
+
+// Interned identifier. A name can carry both a builtin and a user word; the
+// word, once defined, takes precedence.
+struct Symbol {
+    static constexpr uint32_t noBuiltin = UINT32_MAX;
+
+    std::shared_ptr<const Code> source;  // user definition as compiled, null until defined
+    std::shared_ptr<const Code> body;    // source after inlining and folding; what runs
+    uint32_t builtin = noBuiltin;        // index into the builtin table
+};
+
+// Maps every identifier the interpreter has seen to a dense id, so compiled
+// code refers to symbols by index and never looks names up at run time.
+//
+// freeze() moves everything into an immutable base that copies share, so a
+// copy costs only what was interned or rebound since. Lookups check the few
+// rebound symbols before the base; that map is empty unless a word the base
+// knows has been redefined.
+class SymbolTable {
+public:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    SymbolTable() : frozen(std::make_shared<const Frozen>()) {}
+    SymbolTable(const SymbolTable& other)
+        : frozen(other.frozen), frozenCount(other.frozenCount), added(other.added), addedNames(other.addedNames),
+          rebound(other.rebound), dependentLists(other.dependentLists) {
+        reindex();
+    }
+    SymbolTable& operator=(const SymbolTable& other) {
+        frozen = other.frozen;
+        frozenCount = other.frozenCount;
+        added = other.added;
+        addedNames = other.addedNames;
+        rebound = other.rebound;
+        dependentLists = other.dependentLists;
+        reindex();
+        return *this;
+    }
+
+    // Id of `name`, adding it if it is new
+    uint32_t intern(std::wstring_view name) {
+        uint32_t id = find(name);
+        if (id != none) {
+            return id;
+        }
+        id = static_cast<uint32_t>(size());
+        addedNames.emplace_back(name);
+        added.emplace_back();
+        addedIds.emplace(addedNames.back(), id);
+        return id;
+    }
+
+    // Id of `name`, or none if it has never been interned
+    uint32_t find(std::wstring_view name) const {
+        auto it = frozen->ids.find(name);
+        if (it != frozen->ids.end()) {
+            return it->second;
+        }
+        it = addedIds.find(name);
+        return it == addedIds.end() ? none : it->second;
+    }
+
+    const Symbol& operator[](uint32_t id) const {
+        if (id >= frozenCount) {
+            return added[id - frozenCount];
+        }
+        if (!rebound.empty()) {
+            auto it = rebound.find(id);
+            if (it != rebound.end()) return it->second;
+        }
+        return frozen->symbols[id];
+    }
+
+    // Symbol `id` for writing; one from the base is copied out of it first
+    Symbol& edit(uint32_t id) {
+        if (id >= frozenCount) {
+            return added[id - frozenCount];
+        }
+        return rebound.try_emplace(id, frozen->symbols[id]).first->second;
+    }
+
+    // Words whose bodies baked in symbol `id`. They are only needed when
+    // linking, so they live apart from the symbols the run-time lookups read.
+    const std::vector<uint32_t>& dependents(uint32_t id) const {
+        auto it = dependentLists.find(id);
+        if (it != dependentLists.end()) return it->second;
+        static const std::vector<uint32_t> noDependents;
+        return id < frozenCount ? frozen->dependents[id] : noDependents;
+    }
+    std::vector<uint32_t>& editDependents(uint32_t id) {
+        auto [it, inserted] = dependentLists.try_emplace(id);
+        if (inserted && id < frozenCount) it->second = frozen->dependents[id];
+        return it->second;
+    }
+    void clearDependents() {
+        dependentLists.clear();
+        for (uint32_t id = 0; id < frozenCount; ++id) {
+            if (!frozen->dependents[id].empty()) dependentLists[id];
+        }
+    }
+
+    const String& name(uint32_t id) const { return id < frozenCount ? frozen->names[id] : addedNames[id - frozenCount]; }
+    size_t size() const { return frozenCount + added.size(); }
+
+    // Moves every symbol into a new shared base
+    void freeze() {
+        if (added.empty() && rebound.empty() && dependentLists.empty()) {
+            return;
+        }
+        auto next = std::make_shared<Frozen>();
+        next->symbols = frozen->symbols;
+        next->dependents = frozen->dependents;
+        next->names = frozen->names;
+        for (auto& [id, symbol] : rebound) next->symbols[id] = std::move(symbol);
+        next->symbols.insert(next->symbols.end(), std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+        next->names.insert(next->names.end(), addedNames.begin(), addedNames.end());
+        next->dependents.resize(next->symbols.size());
+        for (auto& [id, list] : dependentLists) next->dependents[id] = std::move(list);
+        for (uint32_t id = 0; id < next->names.size(); ++id) {
+            next->ids.emplace(next->names[id], id);
+        }
+        frozen = std::move(next);
+        frozenCount = static_cast<uint32_t>(frozen->symbols.size());
+        added.clear();
+        addedNames.clear();
+        addedIds.clear();
+        rebound.clear();
+        dependentLists.clear();
+    }
+
+private:
+    struct Frozen {
+        std::vector<Symbol> symbols;
+        std::vector<std::vector<uint32_t>> dependents;
+        std::deque<String> names;
+        std::unordered_map<std::wstring_view, uint32_t> ids;
+    };
+
+    // The keys view names, so a copy must rebuild them over its own strings
+    void reindex() {
+        addedIds.clear();
+        for (uint32_t i = 0; i < addedNames.size(); ++i) {
+            addedIds.emplace(addedNames[i], frozenCount + i);
+        }
+    }
+
+    std::shared_ptr<const Frozen> frozen;
+    uint32_t frozenCount = 0;
+    std::vector<Symbol> added;     // ids from frozenCount on
+    std::deque<String> addedNames;  // deque so the views used as keys stay valid
+    std::unordered_map<std::wstring_view, uint32_t> addedIds;
+    std::unordered_map<uint32_t, Symbol> rebound;  // base symbols changed since freeze()
+    std::unordered_map<uint32_t, std::vector<uint32_t>> dependentLists;  // every list changed since freeze()
+};
@@ -0,0 +1,59 @@
+#include "view.hpp"
+#include <functional>
+
+namespace {
+
+// View of `arr`'s buffer starting `offset` elements in; the buffer is cut to
+// the span the shape and strides can reach
+NDArray makeView(const NDArray& arr, size_t offset, std::vector<size_t> shape, std::vector<size_t> strides) {
+    size_t span = 1;
+    for (size_t i = 0; i < shape.size(); ++i) {
+        if (shape[i] == 0) {
+            span = 0;
+            break;
+        }
+        span += (shape[i] - 1) * strides[i];
+    }
+    NDArray view;
+    view.data = arr.data.slice(offset, span);
+    view.shape = std::move(shape);
+    view.strides = std::move(strides);
+    return view;
+}
+
+}  // namespace
+
+NDArray compact(const NDArray& arr) {
+    NDArray result(arr.shape);
+    double* out = result.data.data();
+    std::function<void(size_t, size_t)> copy = [&](size_t axis, size_t offset) {
+        size_t stride = arr.strides[axis];
+        if (axis + 1 == arr.rank()) {
+            for (size_t i = 0; i < arr.shape[axis]; ++i) *out++ = arr.data[offset + i * stride];
+            return;
+        }
+        for (size_t i = 0; i < arr.shape[axis]; ++i) copy(axis + 1, offset + i * stride);
+    };
+    if (arr.size() > 0) copy(0, 0);
+    return result;
+}
+
+NDArray sliceAxis(const NDArray& arr, size_t axis, size_t first, size_t count, size_t step) {
+    std::vector<size_t> shape = arr.shape;
+    std::vector<size_t> strides = arr.strides;
+    shape[axis] = count;
+    strides[axis] *= step;
+    return makeView(arr, first * arr.strides[axis], std::move(shape), std::move(strides));
+}
+
+NDArray transposed(const NDArray& arr) {
+    return makeView(arr, 0, {arr.shape.rbegin(), arr.shape.rend()}, {arr.strides.rbegin(), arr.strides.rend()});
+}
+
+NDArray item(const NDArray& arr, size_t index) {
+    if (arr.rank() == 1) {
+        return makeView(arr, index * arr.strides[0], {1}, {1});
+    }
+    return makeView(arr, index * arr.strides[0], {arr.shape.begin() + 1, arr.shape.end()},
+        {arr.strides.begin() + 1, arr.strides.end()});
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "types.hpp"
+
+// Strided views: arrays that share another array's buffer and reach its
+// elements through their own shape and strides, so taking one costs the same
+// whatever the size of the data. Writing to a view copies first (see Buffer),
+// so the source never changes. Code that walks strides (broadcasting, gemm,
+// printing) reads views in place; the rest gets a compact() copy.
+
+// Row-major copy of a view, holding just its elements
+NDArray compact(const NDArray& arr);
+
+// Every `step`th item along `axis`, `count` of them starting at `first`.
+// The items must exist and count must be at least 1.
+NDArray sliceAxis(const NDArray& arr, size_t axis, size_t first, size_t count, size_t step = 1);
+
+// The same elements with the order of the axes reversed
+NDArray transposed(const NDArray& arr);
+
+// Item `index` along the leading axis: one rank lower, or a single number
+// (shape {1}) from a vector
+NDArray item(const NDArray& arr, size_t index);